@@ -0,0 +1,691 @@
+// hdlc_bench: микро- и макробенчмарки кодирования, CRC, FIFO и обмена ведущий-ведомый
+// результаты выводятся в JSON для сравнения запусков до и после изменений
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fifo.h"
+#include "user.h"
+#include "hdlc.h"
+#include "fsm.h"
+#include "timer.h"
+#include "simd.h"
+#include "trace.h"
+#include "bench.h"
+#include "channel.h"
+#include "metrics.h"
+#include "command.h"
+
+#define BENCH_MAX_PAYLOADS      16                      // максимум размеров информационного поля в одном запуске
+#define BENCH_DEFAULT_TIME_MS   200                     // минимальная длительность одного измерения
+#define BENCH_DEFAULT_SEED      1                       // начальное значение генератора данных
+#define BENCH_DEFAULT_ESCAPE    (2.0 / 256.0)           // доля 0x7E/0x7D как в равномерно случайных данных
+#define BENCH_ENCODED_SIZE      (2 * (HDLC_INFO_MAX_SIZE + HDLC_OVERHEAD_SIZE) + 2)  // худший случай кадра в линии
+#define BENCH_LOSS_MAX_SAMPLES  65536                   // измерений времени восстановления за один профиль
+#define BENCH_LOSS_CHECK_STEPS  256                     // шагов автоматов между проверками времени
+
+
+fifo_typedef fifo_mts = {0};      // FIFO Master To Slave
+fifo_typedef fifo_stm = {0};      // FIFO Slave To Master
+
+typedef struct                                      // параметры запуска
+{
+    uint32_t payload[BENCH_MAX_PAYLOADS];           // размеры информационного поля
+    uint32_t payload_count;                         // количество размеров
+    double escape_density;                          // доля байт информационного поля, требующих байтстаффинга
+    uint32_t time_ms;                               // минимальная длительность одного измерения
+    uint32_t seed;                                  // начальное значение генератора данных
+    const char* output;                             // файл результатов (NULL - stdout)
+    bool loss;                                      // режим --loss: обмен через линию с искажениями
+    bool custom;                                    // профиль искажений задан параметрами (вместо встроенных)
+    channel_profile_typedef profile;                // профиль искажений из параметров
+} bench_options_typedef;
+
+typedef struct                                      // результат одного измерения
+{
+    uint64_t iterations;                            // количество повторов измеряемой операции
+    uint64_t units;                                 // обработано единиц (байт, кадров, операций)
+    uint64_t bytes;                                 // обработано байт (0 - не учитывается)
+    double seconds;                                 // длительность измерения
+} bench_result_typedef;
+
+// измеряемая функция: выполняет iterations повторов, возвращает обработанные единицы
+typedef uint64_t (*bench_function_typedef)(uint64_t iterations);
+
+static bench_options_typedef bench_options;
+static FILE* bench_out;                             // вывод результатов
+static bool bench_first_result = true;              // для разделителей массива JSON
+static uint32_t bench_errors = 0;                   // кадры, не прошедшие проверку при приёме
+
+static uint32_t bench_random_state;                 // состояние генератора xorshift32
+static uint8_t bench_payload[HDLC_INFO_MAX_SIZE];   // информационное поле текущего размера
+static uint32_t bench_payload_length;
+static uint8_t bench_encoded[BENCH_ENCODED_SIZE];   // закодированный кадр с информационным полем bench_payload
+static size_t bench_encoded_length;
+static const hdlc_header_typedef bench_header = {.address=HDLC_SLAVE_ADDR, .control=USER_COMMAND};
+
+static hdlc_tx_context_typedef bench_tx;            // контекст передачи для побайтового кодирования
+static hdlc_rx_context_typedef bench_rx;            // контекст приёма для декодирования
+static fifo_typedef bench_fifo;                     // FIFO размера по умолчанию между кодированием и приёмом
+static volatile uint32_t bench_sink;                // результат вычислений (не дает компилятору выбросить цикл)
+
+/*-------------------------------------------------Подготовка данных-------------------------------------------------------------------------------------------*/
+
+// генератор xorshift32 (одинаковая последовательность на всех платформах при одном seed)
+static uint32_t BenchRandom(void)
+{
+    bench_random_state ^= bench_random_state << 13;
+    bench_random_state ^= bench_random_state >> 17;
+    bench_random_state ^= bench_random_state << 5;
+    return bench_random_state;
+}
+
+// заполнение информационного поля: доля escape_density байт - 0x7E/0x7D, остальные - любые другие значения
+static void BenchPreparePayload(uint32_t length)
+{
+    uint32_t threshold = (uint32_t)(bench_options.escape_density * 4294967295.0);
+
+    bench_random_state = bench_options.seed ? bench_options.seed : BENCH_DEFAULT_SEED;
+    for(uint32_t i = 0; i < length; i++)
+    {
+        uint32_t random = BenchRandom();
+
+        if(random < threshold || (threshold == UINT32_MAX))
+            bench_payload[i] = (random & 1) ? HDLC_ESCAPE : HDLC_FD_FLAG;
+        else
+        {
+            uint8_t byte = (uint8_t)(random >> 24);
+
+            // значения 0x7D и 0x7E сдвигаются за пределы пары
+            bench_payload[i] = (byte == HDLC_ESCAPE || byte == HDLC_FD_FLAG) ? (uint8_t)(byte + 2) : byte;
+        }
+    }
+    bench_payload_length = length;
+    bench_encoded_length = HDLC_EncodeFrame(&bench_header, bench_payload, length, bench_encoded, sizeof(bench_encoded));
+}
+
+/*-------------------------------------------------Измеряемые операции-----------------------------------------------------------------------------------------*/
+
+static uint64_t BenchCalculateFCS(uint64_t iterations)
+{
+    uint8_t fcs_msb=0, fcs_lsb=0;
+
+    for(uint64_t i = 0; i < iterations; i++)
+        HDLC_CalculateFCS(bench_payload, (int)bench_payload_length, &fcs_msb, &fcs_lsb);
+    bench_sink = (uint32_t)(fcs_msb << 8) | fcs_lsb;
+    return iterations * bench_payload_length;
+}
+
+static uint64_t BenchCrcBitwise(uint64_t iterations)
+{
+    uint16_t crc = CRC16_INIT;
+
+    for(uint64_t i = 0; i < iterations; i++)
+        crc = CRC16_UpdateBitwise(crc, bench_payload, bench_payload_length);
+    bench_sink = crc;
+    return iterations * bench_payload_length;
+}
+
+static uint64_t BenchCrcTable(uint64_t iterations)
+{
+    uint16_t crc = CRC16_INIT;
+
+    for(uint64_t i = 0; i < iterations; i++)
+        crc = CRC16_UpdateTable(crc, bench_payload, bench_payload_length);
+    bench_sink = crc;
+    return iterations * bench_payload_length;
+}
+
+static uint64_t BenchCrcSlice8(uint64_t iterations)
+{
+    uint16_t crc = CRC16_INIT;
+
+    for(uint64_t i = 0; i < iterations; i++)
+        crc = CRC16_UpdateSlice8(crc, bench_payload, bench_payload_length);
+    bench_sink = crc;
+    return iterations * bench_payload_length;
+}
+
+// инверсия и отражение информационного поля (команды ведомого)
+static uint64_t BenchInvert(uint64_t iterations)
+{
+    static uint8_t reply[HDLC_INFO_MAX_SIZE];
+
+    for(uint64_t i = 0; i < iterations; i++)
+        SIMD_InvertBytes(reply, bench_payload, bench_payload_length);
+    bench_sink = reply[0];
+    return iterations * bench_payload_length;
+}
+
+static uint64_t BenchMirror(uint64_t iterations)
+{
+    static uint8_t reply[HDLC_INFO_MAX_SIZE];
+
+    for(uint64_t i = 0; i < iterations; i++)
+        SIMD_MirrorBytes(reply, bench_payload, bench_payload_length);
+    bench_sink = reply[0];
+    return iterations * bench_payload_length;
+}
+
+// кодирование кадра целиком в буффер
+static uint64_t BenchEncodeBlock(uint64_t iterations)
+{
+    size_t length=0;
+
+    for(uint64_t i = 0; i < iterations; i++)
+        length = HDLC_EncodeFrame(&bench_header, bench_payload, bench_payload_length, bench_encoded, sizeof(bench_encoded));
+    bench_sink = (uint32_t)length;
+    return iterations;
+}
+
+// побайтовое кодирование через FIFO (как в конечном автомате ведущего)
+static uint64_t BenchSendByte(uint64_t iterations)
+{
+    uint8_t byte=0;
+
+    FifoInit(&bench_fifo);
+    for(uint64_t i = 0; i < iterations; i++)
+    {
+        HDLC_TxContextInitBorrowed(&bench_tx, &bench_header, bench_payload, bench_payload_length);
+        while(bench_tx.tx_stage != TX_STAGE_COMPLETED)
+        {
+            HDLC_SendByte(&bench_tx, &bench_fifo);
+            while(!FifoIsEmpty(&bench_fifo))
+                FifoReadByte(&bench_fifo, &byte);
+        }
+    }
+    bench_sink = byte;
+    return iterations;
+}
+
+// побайтовый приём через FIFO (как в конечном автомате ведомого)
+static uint64_t BenchReceiveByte(uint64_t iterations)
+{
+    FifoInit(&bench_fifo);
+    for(uint64_t i = 0; i < iterations; i++)
+    {
+        HDLC_RxContextInit(&bench_rx);
+        for(size_t j = 0; j < bench_encoded_length; j++)
+        {
+            FifoWriteByte(&bench_fifo, bench_encoded[j]);
+            HDLC_ReceiveByte(&bench_rx, &bench_fifo, HDLC_SLAVE_ADDR);
+        }
+        if(!bench_rx.frame_assembled || !bench_rx.frame_correct)
+            bench_errors++;
+    }
+    return iterations;
+}
+
+// блочный приём из непрерывного участка
+static uint64_t BenchReceiveBlock(uint64_t iterations)
+{
+    for(uint64_t i = 0; i < iterations; i++)
+    {
+        HDLC_RxContextInit(&bench_rx);
+        HDLC_ReceiveBlock(&bench_rx, bench_encoded, bench_encoded_length, HDLC_SLAVE_ADDR);
+        if(!bench_rx.frame_assembled || !bench_rx.frame_correct)
+            bench_errors++;
+    }
+    return iterations;
+}
+
+// счетчик ведущего в метриках (без снятия снимка: проверяется на каждом шаге обмена)
+static uint64_t BenchMasterCounter(metrics_counter_typedef counter)
+{
+    return atomic_load_explicit(&METRICS_Link(HDLC_MASTER_ADDR)->counter[counter], memory_order_relaxed);
+}
+
+// обмен ведущий-ведомый: повторы - шаги конечных автоматов, единицы - принятые ведущим ответы
+static uint64_t BenchRoundTrip(uint64_t iterations)
+{
+    uint64_t replies = BenchMasterCounter(METRICS_REPLIES);
+
+    for(uint64_t i = 0; i < iterations; i++)
+    {
+        FSM_Master();
+        FSM_Slave();
+    }
+    return BenchMasterCounter(METRICS_REPLIES) - replies;
+}
+
+/*-------------------------------------------------Запуск и вывод----------------------------------------------------------------------------------------------*/
+
+// повтор измерения с увеличением числа итераций, пока оно не займет time_ms
+static bench_result_typedef BenchRun(bench_function_typedef function)
+{
+    uint64_t time_ns = (uint64_t)bench_options.time_ms * 1000000u;
+    uint64_t iterations = 1;
+    bench_result_typedef result = {0};
+
+    function(1);                                    // прогрев кэшей и ленивой инициализации
+    while(1)
+    {
+        uint64_t start = GetCurrentTimeNs();
+        uint64_t units = function(iterations);
+        uint64_t elapsed = GetCurrentTimeNs() - start;
+
+        if(elapsed >= time_ns || iterations >= (UINT64_MAX / 16))
+        {
+            result.iterations = iterations;
+            result.units = units;
+            result.seconds = (double)elapsed / 1e9;
+            return result;
+        }
+
+        // оценка числа итераций до нужной длительности с запасом, рост не более чем в 10 раз за шаг
+        if(elapsed == 0 || iterations * 10 < (uint64_t)((double)iterations * time_ns / elapsed * 1.2))
+            iterations *= 10;
+        else
+            iterations = (uint64_t)((double)iterations * time_ns / elapsed * 1.2) + 1;
+    }
+}
+
+// запись результата в массив JSON (payload и fifo_size выводятся, если не равны UINT32_MAX)
+static void BenchReport(const char* name, const char* unit, uint32_t payload, uint32_t fifo_size, bench_result_typedef* result)
+{
+    double seconds = result->seconds > 0 ? result->seconds : 1e-9;
+
+    fprintf(bench_out, "%s\n    {\"name\": \"%s\", \"unit\": \"%s\"", bench_first_result ? "" : ",", name, unit);
+    if(payload != UINT32_MAX)
+        fprintf(bench_out, ", \"payload\": %u, \"encoded\": %u", payload, (unsigned)bench_encoded_length);
+    if(fifo_size != UINT32_MAX)
+        fprintf(bench_out, ", \"fifo_size\": %u", fifo_size);
+    fprintf(bench_out, ", \"iterations\": %llu, \"units\": %llu, \"seconds\": %.6f, \"per_second\": %.1f",
+            (unsigned long long)result->iterations, (unsigned long long)result->units, result->seconds, result->units / seconds);
+    if(result->bytes != 0)
+        fprintf(bench_out, ", \"bytes_per_second\": %.1f", result->bytes / seconds);
+    fprintf(bench_out, "}");
+    bench_first_result = false;
+}
+
+// измерение для текущего информационного поля; bytes_per_unit - байт на единицу для расчета байт/с (0 - не выводится)
+static void BenchMeasure(const char* name, const char* unit, bench_function_typedef function, uint64_t bytes_per_unit)
+{
+    bench_result_typedef result = BenchRun(function);
+
+    result.bytes = result.units * bytes_per_unit;
+    BenchReport(name, unit, bench_payload_length, UINT32_MAX, &result);
+}
+
+typedef struct                                      // FIFO одного размера (bench_fifo.c)
+{
+    uint32_t size;
+    bench_function_typedef bytes;                   // побайтовые операции
+    bench_function_typedef span;                    // блочные операции
+} bench_fifo_typedef;
+
+#define BENCH_FIFO_ENTRY(size)  {size, BenchFifoBytes##size, BenchFifoSpan##size},
+static const bench_fifo_typedef bench_fifos[] = { BENCH_FIFO_SIZE_LIST(BENCH_FIFO_ENTRY) };
+
+static void BenchFifo(void)
+{
+    for(size_t i = 0; i < sizeof(bench_fifos) / sizeof(bench_fifos[0]); i++)
+    {
+        bench_result_typedef result = BenchRun(bench_fifos[i].bytes);
+
+        BenchReport("fifo_bytes", "ops", UINT32_MAX, bench_fifos[i].size, &result);
+        result = BenchRun(bench_fifos[i].span);
+        result.bytes = result.units;
+        BenchReport("fifo_span", "bytes", UINT32_MAX, bench_fifos[i].size, &result);
+    }
+}
+
+/*-------------------------------------------------Обмен через линию с искажениями-----------------------------------------------------------------------------*/
+#ifdef CHANNEL_FAULTS
+
+typedef struct                                      // встроенный профиль искажений
+{
+    const char* name;
+    channel_profile_typedef profile;
+} bench_loss_profile_typedef;
+
+static const bench_loss_profile_typedef bench_loss_profiles[] =
+{
+    {"clean",       {.bit_error_rate = 0.0}},
+    {"ber_1e-5",    {.bit_error_rate = 1e-5}},
+    {"ber_1e-4",    {.bit_error_rate = 1e-4}},
+    {"drop_1e-4",   {.drop_rate = 1e-4}},
+    {"dup_1e-4",    {.duplicate_rate = 1e-4}},
+    {"burst_16",    {.burst_rate = 1e-5, .burst_length = 16}},
+    {"flag_1e-2",   {.flag_error_rate = 1e-2}},
+};
+
+static channel_typedef bench_channel_mts;           // искажения кадров ведущего
+static channel_typedef bench_channel_stm;           // искажения ответов ведомого
+static uint32_t bench_recovery[BENCH_LOSS_MAX_SAMPLES];    // времена восстановления, мкс
+
+static int BenchCompareU32(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+
+    return (x > y) - (x < y);
+}
+
+// процентиль отсортированного массива (ближайший ранг)
+static uint32_t BenchPercentile(const uint32_t* sorted, uint32_t count, uint32_t percent)
+{
+    uint32_t rank;
+
+    if(count == 0)
+        return 0;
+    rank = (uint32_t)(((uint64_t)count * percent + 99) / 100);
+    return sorted[(rank > 0) ? rank - 1 : 0];
+}
+
+// обмен без искажений до двух ответов подряд: ведущий забывает удвоения таймаута предыдущего профиля
+// (первый ответ после таймаута по алгоритму Карна не измеряется)
+static void BenchLossSettle(void)
+{
+    uint64_t replies = BenchMasterCounter(METRICS_REPLIES);
+    uint64_t deadline = GetCurrentTimeUs() + 4 * (uint64_t)MASTER_RTO_MAX_US;
+
+    while(BenchMasterCounter(METRICS_REPLIES) - replies < 2 && GetCurrentTimeUs() < deadline)
+    {
+        FSM_Master();
+        FSM_Slave();
+    }
+}
+
+// обмен ведущий-ведомый в течение time_ms через линию с профилем profile в обе стороны
+// восстановление - интервал между соседними ответами, за который ведущий повторял кадры или ждал таймаут
+static void BenchLoss(const char* name, const channel_profile_typedef* profile)
+{
+    uint64_t replies, retransmits, timeouts;        // счетчики ведущего в начале измерения
+    uint64_t losses;                                // повторов и таймаутов на момент последнего ответа
+    uint64_t last_reply;
+    uint32_t samples = 0;
+    uint64_t recoveries = 0;
+    uint64_t start, last_reply_us, now;
+    double seconds;
+
+    BenchLossSettle();
+    CHANNEL_Init(&bench_channel_mts, profile, (uint64_t)bench_options.seed * 2);
+    CHANNEL_Init(&bench_channel_stm, profile, (uint64_t)bench_options.seed * 2 + 1);
+    CHANNEL_Attach(&bench_channel_mts, &fifo_mts);
+    CHANNEL_Attach(&bench_channel_stm, &fifo_stm);
+
+    replies = BenchMasterCounter(METRICS_REPLIES);
+    retransmits = BenchMasterCounter(METRICS_RETRANSMITS);
+    timeouts = BenchMasterCounter(METRICS_TIMEOUTS);
+    losses = retransmits + timeouts;
+    last_reply = replies;
+    start = GetCurrentTimeUs();
+    last_reply_us = start;
+    now = start;
+
+    for(uint32_t step = 0; ; step++)
+    {
+        FSM_Master();
+        FSM_Slave();
+
+        if(BenchMasterCounter(METRICS_REPLIES) != last_reply)
+        {
+            now = GetCurrentTimeUs();
+            if(BenchMasterCounter(METRICS_RETRANSMITS) + BenchMasterCounter(METRICS_TIMEOUTS) != losses)
+            {
+                if(samples < BENCH_LOSS_MAX_SAMPLES)
+                    bench_recovery[samples++] = (now - last_reply_us > UINT32_MAX) ? UINT32_MAX : (uint32_t)(now - last_reply_us);
+                recoveries++;
+                losses = BenchMasterCounter(METRICS_RETRANSMITS) + BenchMasterCounter(METRICS_TIMEOUTS);
+            }
+            last_reply = BenchMasterCounter(METRICS_REPLIES);
+            last_reply_us = now;
+        }
+        if(step % BENCH_LOSS_CHECK_STEPS == 0 && (now = GetCurrentTimeUs()) - start >= (uint64_t)bench_options.time_ms * 1000u)
+            break;
+    }
+
+    CHANNEL_Detach(&bench_channel_mts);
+    CHANNEL_Detach(&bench_channel_stm);
+
+    seconds = (double)(now - start) / 1e6;
+    replies = BenchMasterCounter(METRICS_REPLIES) - replies;
+    qsort(bench_recovery, samples, sizeof(bench_recovery[0]), BenchCompareU32);
+
+    fprintf(bench_out, "%s\n    {\"name\": \"loss\", \"profile\": \"%s\", \"payload\": %u, \"encoded\": %u, \"seconds\": %.6f, "
+            "\"replies\": %llu, \"goodput_bytes_per_second\": %.1f, \"retransmits\": %llu, \"timeouts\": %llu, "
+            "\"recoveries\": %llu, \"recovery_us\": {\"p50\": %u, \"p90\": %u, \"p99\": %u, \"max\": %u}, "
+            "\"channel\": {\"bytes\": %llu, \"bit_errors\": %llu, \"dropped\": %llu, \"duplicated\": %llu, \"bursts\": %llu, \"flag_errors\": %llu}}",
+            bench_first_result ? "" : ",", name, bench_payload_length, (unsigned)bench_encoded_length, seconds,
+            (unsigned long long)replies, (double)replies * bench_payload_length / (seconds > 0 ? seconds : 1e-9),
+            (unsigned long long)(BenchMasterCounter(METRICS_RETRANSMITS) - retransmits),
+            (unsigned long long)(BenchMasterCounter(METRICS_TIMEOUTS) - timeouts),
+            (unsigned long long)recoveries, BenchPercentile(bench_recovery, samples, 50), BenchPercentile(bench_recovery, samples, 90),
+            BenchPercentile(bench_recovery, samples, 99), samples ? bench_recovery[samples - 1] : 0,
+            (unsigned long long)(bench_channel_mts.stats.bytes + bench_channel_stm.stats.bytes),
+            (unsigned long long)(bench_channel_mts.stats.bit_errors + bench_channel_stm.stats.bit_errors),
+            (unsigned long long)(bench_channel_mts.stats.dropped + bench_channel_stm.stats.dropped),
+            (unsigned long long)(bench_channel_mts.stats.duplicated + bench_channel_stm.stats.duplicated),
+            (unsigned long long)(bench_channel_mts.stats.bursts + bench_channel_stm.stats.bursts),
+            (unsigned long long)(bench_channel_mts.stats.flag_errors + bench_channel_stm.stats.flag_errors));
+    bench_first_result = false;
+}
+
+// все профили для текущего информационного поля: встроенные или заданный параметрами
+static void BenchLossProfiles(void)
+{
+    if(bench_options.custom)
+    {
+        BenchLoss("custom", &bench_options.profile);
+        return;
+    }
+    for(size_t i = 0; i < sizeof(bench_loss_profiles) / sizeof(bench_loss_profiles[0]); i++)
+        BenchLoss(bench_loss_profiles[i].name, &bench_loss_profiles[i].profile);
+}
+
+#endif
+
+static void BenchUsage(const char* program)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --payload N[,N...]   information field sizes, up to %d values (default 16,100,256,4096)\n"
+            "  --escape P           share of 0x7E/0x7D bytes in the payload, 0..1 (default %.4f)\n"
+            "  --time-ms T          minimal duration of one measurement (default %d)\n"
+            "  --seed S             payload generator seed (default %d)\n"
+            "  --output FILE        write JSON to FILE instead of stdout\n"
+    #ifdef CHANNEL_FAULTS
+            "  --loss               only master-slave exchange over impaired lines (built-in profiles)\n"
+            "  --ber P              custom profile: bit error rate (implies --loss, as do the options below)\n"
+            "  --drop P             custom profile: byte drop probability\n"
+            "  --dup P              custom profile: byte duplicate probability\n"
+            "  --burst P            custom profile: burst start probability per byte\n"
+            "  --burst-length N     custom profile: bytes replaced by one burst (default 16)\n"
+            "  --flag P             custom profile: flag corruption probability\n"
+    #endif
+            , program, BENCH_MAX_PAYLOADS, BENCH_DEFAULT_ESCAPE, BENCH_DEFAULT_TIME_MS, BENCH_DEFAULT_SEED);
+}
+
+static bool BenchParsePayloads(const char* list)
+{
+    char* end;
+
+    bench_options.payload_count = 0;
+    while(*list)
+    {
+        unsigned long size = strtoul(list, &end, 0);
+
+        if(end == list || size > HDLC_INFO_MAX_SIZE || bench_options.payload_count >= BENCH_MAX_PAYLOADS)
+            return false;
+        bench_options.payload[bench_options.payload_count++] = (uint32_t)size;
+        list = (*end == ',') ? end + 1 : end;
+        if(*end != ',' && *end != '\0')
+            return false;
+    }
+    return bench_options.payload_count > 0;
+}
+
+#ifdef CHANNEL_FAULTS
+// параметр профиля искажений: вероятность 0..1
+static bool BenchParseRate(const char* value, double* rate)
+{
+    *rate = strtod(value, NULL);
+    bench_options.loss = true;
+    bench_options.custom = true;
+    return *rate >= 0.0 && *rate <= 1.0;
+}
+#endif
+
+static bool BenchParseOptions(int argc, char** argv)
+{
+    bench_options = (bench_options_typedef){.payload={16, 100, 256, 4096}, .payload_count=4, .escape_density=BENCH_DEFAULT_ESCAPE,
+                                            .time_ms=BENCH_DEFAULT_TIME_MS, .seed=BENCH_DEFAULT_SEED,
+                                            .profile={.burst_length=16}};
+
+    for(int i = 1; i < argc; i++)
+    {
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+    #ifdef CHANNEL_FAULTS
+        // единственный параметр без значения
+        if(strcmp(argv[i], "--loss") == 0)
+        {
+            bench_options.loss = true;
+            continue;
+        }
+    #endif
+        if(value == NULL)
+            return false;
+        if(strcmp(argv[i], "--payload") == 0)
+        {
+            if(!BenchParsePayloads(value))
+                return false;
+        }
+        else if(strcmp(argv[i], "--escape") == 0)
+        {
+            bench_options.escape_density = strtod(value, NULL);
+            if(bench_options.escape_density < 0.0 || bench_options.escape_density > 1.0)
+                return false;
+        }
+        else if(strcmp(argv[i], "--time-ms") == 0)
+            bench_options.time_ms = (uint32_t)strtoul(value, NULL, 0);
+        else if(strcmp(argv[i], "--seed") == 0)
+            bench_options.seed = (uint32_t)strtoul(value, NULL, 0);
+        else if(strcmp(argv[i], "--output") == 0)
+            bench_options.output = value;
+    #ifdef CHANNEL_FAULTS
+        else if(strcmp(argv[i], "--ber") == 0)
+        {
+            if(!BenchParseRate(value, &bench_options.profile.bit_error_rate))
+                return false;
+        }
+        else if(strcmp(argv[i], "--drop") == 0)
+        {
+            if(!BenchParseRate(value, &bench_options.profile.drop_rate))
+                return false;
+        }
+        else if(strcmp(argv[i], "--dup") == 0)
+        {
+            if(!BenchParseRate(value, &bench_options.profile.duplicate_rate))
+                return false;
+        }
+        else if(strcmp(argv[i], "--burst") == 0)
+        {
+            if(!BenchParseRate(value, &bench_options.profile.burst_rate))
+                return false;
+        }
+        else if(strcmp(argv[i], "--burst-length") == 0)
+        {
+            bench_options.profile.burst_length = (uint32_t)strtoul(value, NULL, 0);
+            bench_options.loss = true;
+            bench_options.custom = true;
+        }
+        else if(strcmp(argv[i], "--flag") == 0)
+        {
+            if(!BenchParseRate(value, &bench_options.profile.flag_error_rate))
+                return false;
+        }
+    #endif
+        else
+            return false;
+        i++;
+    }
+    return bench_options.time_ms > 0;
+}
+
+int main(int argc, char** argv)
+{
+    if(!BenchParseOptions(argc, argv))
+    {
+        BenchUsage(argv[0]);
+        return 2;
+    }
+    if(!CRC16_SelfTest())
+    {
+        fprintf(stderr, "CRC self-test failed!\n");
+        return 1;
+    }
+    if(!METRICS_SelfTest())
+    {
+        fprintf(stderr, "Metrics self-test failed!\n");
+        return 1;
+    }
+    if(!COMMAND_SelfTest())
+    {
+        fprintf(stderr, "Command batch self-test failed!\n");
+        return 1;
+    }
+
+    bench_out = stdout;
+    if(bench_options.output != NULL && (bench_out = fopen(bench_options.output, "w")) == NULL)
+    {
+        perror(bench_options.output);
+        return 1;
+    }
+
+    TRACE_SetLevel(TRACE_LEVEL_OFF);    // журнал не должен влиять на измерения
+    SIMD_Init();
+    FifoInit(&fifo_mts);
+    FifoInit(&fifo_stm);
+
+    fprintf(bench_out, "{\n  \"benchmark\": \"hdlc_bench\",\n  \"config\": {\"crc_engine\": %d, \"byte_kernels\": \"%s\", "
+            "\"fifo_spsc\": %s, \"fifo_size\": %d, \"seq_modulo\": %d, \"window\": %d, \"slaves\": %d, "
+            "\"escape_density\": %.6f, \"time_ms\": %u, \"seed\": %u},\n  \"results\": [",
+            CRC_ENGINE, SIMD_KernelName(),
+    #ifdef FIFO_SPSC
+            "true",
+    #else
+            "false",
+    #endif
+            FIFO_SIZE, HDLC_SEQ_MODULO, HDLC_SEQ_MODULO ? MASTER_WINDOW_SIZE : 1, HDLC_SLAVE_COUNT,
+            bench_options.escape_density, bench_options.time_ms, bench_options.seed);
+
+    for(uint32_t i = 0; i < bench_options.payload_count; i++)
+    {
+        BenchPreparePayload(bench_options.payload[i]);
+
+    #ifdef CHANNEL_FAULTS
+        if(bench_options.loss)
+        {
+            memcpy(master_tx_context.internal_tx_buffer, bench_payload, bench_payload_length);
+            master_tx_context.internal_tx_length = bench_payload_length;
+            BenchLossProfiles();
+            continue;
+        }
+    #endif
+
+        BenchMeasure("fcs", "bytes", BenchCalculateFCS, 1);
+        BenchMeasure("crc_bitwise", "bytes", BenchCrcBitwise, 1);
+        BenchMeasure("crc_table", "bytes", BenchCrcTable, 1);
+        BenchMeasure("crc_slice8", "bytes", BenchCrcSlice8, 1);
+        BenchMeasure("invert", "bytes", BenchInvert, 1);
+        BenchMeasure("mirror", "bytes", BenchMirror, 1);
+        BenchMeasure("encode_block", "frames", BenchEncodeBlock, bench_encoded_length);
+        BenchMeasure("send_byte", "frames", BenchSendByte, bench_encoded_length);
+        BenchMeasure("receive_byte", "frames", BenchReceiveByte, bench_encoded_length);
+        BenchMeasure("receive_block", "frames", BenchReceiveBlock, bench_encoded_length);
+
+        // ведущий отправляет текущее информационное поле, ведомый отвечает полем той же длины
+        memcpy(master_tx_context.internal_tx_buffer, bench_payload, bench_payload_length);
+        master_tx_context.internal_tx_length = bench_payload_length;
+        BenchMeasure("round_trip", "replies", BenchRoundTrip, 0);
+    }
+    if(!bench_options.loss)
+        BenchFifo();
+
+    fprintf(bench_out, "\n  ],\n  \"errors\": %u\n}\n", bench_errors);
+    if(bench_out != stdout)
+        fclose(bench_out);
+
+    return bench_errors ? 1 : 0;
+}
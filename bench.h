@@ -0,0 +1,16 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+// размеры FIFO, для которых bench_fifo.c собирается отдельно (список совпадает с BENCH_FIFO_SIZES в CmakeLists.txt)
+#define BENCH_FIFO_SIZE_LIST(X)     X(8) X(64) X(1024) X(4096)
+
+// функции измерения FIFO одного размера; возвращают количество выполненных операций (байт записано + прочитано)
+#define BENCH_FIFO_DECLARE(size)                                        \
+    uint64_t BenchFifoBytes##size(uint64_t iterations);                 \
+    uint64_t BenchFifoSpan##size(uint64_t iterations);
+
+BENCH_FIFO_SIZE_LIST(BENCH_FIFO_DECLARE)
+
+#endif
@@ -0,0 +1,50 @@
+// измерение FIFO для одного размера: файл собирается несколько раз с разными -DFIFO_SIZE
+#include "fifo.h"
+#include "bench.h"
+
+#define BENCH_NAME_(prefix, size)   prefix##size
+#define BENCH_NAME(prefix, size)    BENCH_NAME_(prefix, size)
+
+static fifo_typedef bench_fifo;                 // FIFO размера FIFO_SIZE
+static volatile uint8_t bench_sink;             // результат чтения (не дает компилятору выбросить цикл)
+
+// побайтовые операции: заполнение FIFO до полного и опустошение до пустого
+uint64_t BENCH_NAME(BenchFifoBytes, FIFO_SIZE)(uint64_t iterations)
+{
+    uint64_t operations=0;
+    uint8_t data=0;
+
+    FifoInit(&bench_fifo);
+    for(uint64_t i = 0; i < iterations; i++)
+    {
+        while(!FifoIsFull(&bench_fifo))
+        {
+            FifoWriteByte(&bench_fifo, data++);
+            operations++;
+        }
+        while(!FifoIsEmpty(&bench_fifo))
+        {
+            FifoReadByte(&bench_fifo, &data);
+            operations++;
+        }
+    }
+    bench_sink = data;
+    return operations;
+}
+
+// блочные операции: запись и чтение участками в 3/4 FIFO (позиция смещается, часть участков переходит через конец буффера)
+uint64_t BENCH_NAME(BenchFifoSpan, FIFO_SIZE)(uint64_t iterations)
+{
+    static uint8_t data[FIFO_SIZE];
+    uint32_t chunk = FIFO_SIZE - FIFO_SIZE / 4;
+    uint64_t operations=0;
+
+    FifoInit(&bench_fifo);
+    for(uint64_t i = 0; i < iterations; i++)
+    {
+        operations += FifoWrite(&bench_fifo, data, chunk);
+        operations += FifoRead(&bench_fifo, data, chunk);
+    }
+    bench_sink = data[0];
+    return operations;
+}
@@ -0,0 +1,417 @@
+// hdlc_capture: разбор записи линии HDLC (сырые байты в файле) на кадры с проверкой FCS
+// файл отображается в память и делится на участки по флагам FD, участки разбираются параллельно потоками,
+// записи о кадрах выводятся в порядке файла (CSV), итоги по ошибкам - в stderr
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "user.h"
+#include "hdlc.h"
+#include "pool.h"
+#include "simd.h"
+#include "timer.h"
+#include "trace.h"
+
+#define CAPTURE_MAX_THREADS         64                  // потоков разбора (не больше буфферов пула: по одному на контекст приёма)
+#define CAPTURE_DEFAULT_CHUNK_MB    16                  // номинальный размер участка, МиБ
+#define CAPTURE_WINDOW              4                   // разобранных, но еще не выведенных участков на поток
+#define CAPTURE_FRAMES_INITIAL      1024                // начальный размер массива записей участка
+
+typedef enum                                            // результат разбора кадра (после значений hdlc_rx_error_typedef)
+{
+    CAPTURE_ABORTED = HDLC_RX_ERROR_COUNT,              // ESC перед флагом FD: кадр прерван передатчиком
+    CAPTURE_TRUNCATED,                                  // запись закончилась до закрывающего флага FD
+    CAPTURE_STATUS_COUNT                                // количество значений
+} capture_status_typedef;
+
+typedef struct                                          // запись о кадре
+{
+    uint64_t offset;                                    // смещение открывающего флага FD в файле
+    uint32_t wire_length;                               // байт в линии от флага до флага включительно
+    uint32_t info_length;                               // длина информационного поля (только у принятого кадра)
+    uint8_t address;                                    // адрес
+    uint8_t control;                                    // команда или функция S-кадра
+    uint8_t ns;                                         // N(S) (при HDLC_SEQ_MODULO != 0)
+    uint8_t nr;                                         // N(R) (при HDLC_SEQ_MODULO != 0)
+    bool supervisory;                                   // S-кадр
+    uint8_t status;                                     // HDLC_RX_OK, причина отбрасывания или capture_status_typedef
+} capture_frame_typedef;
+
+typedef struct                                          // участок файла
+{
+    const uint8_t* start;                               // открывающий флаг FD первого кадра участка
+    const uint8_t* end;                                 // за последним байтом участка (флаг начала следующего участка входит в оба)
+    capture_frame_typedef* frames;                      // записи о кадрах (NULL при --summary)
+    size_t frame_count;                                 // количество записей
+    size_t frame_capacity;                              // размер массива записей
+    uint64_t status_count[CAPTURE_STATUS_COUNT];        // кадров по результатам разбора
+    uint64_t info_bytes;                                // байт информационных полей принятых кадров
+    bool done;                                          // участок разобран (защищен capture_lock)
+} capture_chunk_typedef;
+
+typedef struct                                          // параметры запуска
+{
+    const char* input;                                  // файл записи линии
+    const char* output;                                 // файл записей о кадрах (NULL - stdout)
+    uint32_t threads;                                   // потоков разбора (0 - по числу процессоров)
+    uint32_t chunk_mb;                                  // номинальный размер участка, МиБ
+    bool summary;                                       // только итоги, без записей о кадрах
+} capture_options_typedef;
+
+static capture_options_typedef capture_options;
+static const uint8_t* capture_data;                     // отображенный файл
+static capture_chunk_typedef* capture_chunks;           // участки в порядке файла
+static size_t capture_chunk_count;                      // количество участков
+static atomic_size_t capture_next_chunk;                // следующий участок для разбора
+static size_t capture_printed;                          // выведено участков (защищен capture_lock)
+static size_t capture_window;                           // участков, на которые разбор может опережать вывод
+static pthread_mutex_t capture_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t capture_chunk_done = PTHREAD_COND_INITIALIZER;     // участок разобран
+static pthread_cond_t capture_chunk_printed = PTHREAD_COND_INITIALIZER;  // участок выведен
+
+// имя результата разбора кадра
+static const char* CaptureStatusName(uint8_t status)
+{
+    switch(status)
+    {
+        case CAPTURE_ABORTED:       return "aborted";
+        case CAPTURE_TRUNCATED:     return "truncated";
+        default:                    return HDLC_RxErrorName((hdlc_rx_error_typedef)status);
+    }
+}
+
+// добавление записи о кадре участка (при нехватке памяти запись не сохраняется, итоги учитываются)
+static void CaptureRecord(capture_chunk_typedef* chunk, const capture_frame_typedef* frame)
+{
+    chunk->status_count[frame->status]++;
+    if(capture_options.summary)
+        return;
+
+    if(chunk->frame_count == chunk->frame_capacity)
+    {
+        size_t capacity = chunk->frame_capacity ? chunk->frame_capacity * 2 : CAPTURE_FRAMES_INITIAL;
+        capture_frame_typedef* frames = realloc(chunk->frames, capacity * sizeof(capture_frame_typedef));
+
+        if(frames == NULL)
+            return;
+        chunk->frames = frames;
+        chunk->frame_capacity = capacity;
+    }
+    chunk->frames[chunk->frame_count++] = *frame;
+}
+
+// разбор одного кадра между флагами open и close (оба флага входят в кадр)
+static void CaptureFrame(hdlc_rx_context_typedef* rx_context, capture_chunk_typedef* chunk,
+                         const uint8_t* open, const uint8_t* close)
+{
+    capture_frame_typedef frame = {.offset = (uint64_t)(open - capture_data), .wire_length = (uint32_t)(close - open + 1)};
+
+    if(close[-1] == HDLC_ESCAPE)
+    {
+        // в корректном потоке ESC не стоит перед FD: передатчик прервал кадр
+        frame.status = CAPTURE_ABORTED;
+        CaptureRecord(chunk, &frame);
+        return;
+    }
+
+    HDLC_RxContextInit(rx_context);
+    rx_context->rx_error = HDLC_RX_OK;
+    HDLC_ReceiveBlock(rx_context, open, (size_t)(close - open + 1), HDLC_BROADCAST_ADDR);
+
+    if(rx_context->frame_assembled && rx_context->frame_correct)
+    {
+        frame.status = HDLC_RX_OK;
+        frame.address = rx_context->rx_data.address;
+        frame.control = rx_context->rx_data.control;
+        frame.ns = rx_context->rx_data.ns;
+        frame.nr = rx_context->rx_data.nr;
+        frame.supervisory = rx_context->rx_data.supervisory;
+        frame.info_length = rx_context->rx_data.info_length;
+        chunk->info_bytes += frame.info_length;
+    }
+    else
+    {
+        frame.status = (rx_context->rx_error != HDLC_RX_OK) ? (uint8_t)rx_context->rx_error : (uint8_t)HDLC_RX_WRONG_SIZE;
+    }
+    CaptureRecord(chunk, &frame);
+}
+
+// разбор участка: кадры между соседними флагами FD, пустые кадры (подряд идущие флаги) пропускаются
+static void CaptureChunk(hdlc_rx_context_typedef* rx_context, capture_chunk_typedef* chunk)
+{
+    const uint8_t* open = chunk->start;
+
+    while(open + 1 < chunk->end)
+    {
+        const uint8_t* close = memchr(open + 1, HDLC_FD_FLAG, (size_t)(chunk->end - open - 1));
+
+        if(close == NULL)
+        {
+            // запись оборвалась внутри кадра
+            capture_frame_typedef frame = {.offset = (uint64_t)(open - capture_data),
+                                           .wire_length = (uint32_t)(chunk->end - open), .status = CAPTURE_TRUNCATED};
+            CaptureRecord(chunk, &frame);
+            break;
+        }
+        if(close > open + 1)
+            CaptureFrame(rx_context, chunk, open, close);
+        open = close;
+    }
+}
+
+// поток разбора: участки берутся по порядку, разбор опережает вывод не больше чем на capture_window участков
+static void* CaptureWorker(void* arg)
+{
+    hdlc_rx_context_typedef rx_context = {0};
+
+    (void)arg;
+    rx_context.promiscuous = true;                      // в записи кадры всех узлов шины
+
+    while(1)
+    {
+        size_t index = atomic_fetch_add_explicit(&capture_next_chunk, 1, memory_order_relaxed);
+
+        if(index >= capture_chunk_count)
+            break;
+
+        pthread_mutex_lock(&capture_lock);
+        while(index >= capture_printed + capture_window)
+            pthread_cond_wait(&capture_chunk_printed, &capture_lock);
+        pthread_mutex_unlock(&capture_lock);
+
+        CaptureChunk(&rx_context, &capture_chunks[index]);
+
+        pthread_mutex_lock(&capture_lock);
+        capture_chunks[index].done = true;
+        pthread_cond_broadcast(&capture_chunk_done);
+        pthread_mutex_unlock(&capture_lock);
+    }
+
+    FrameRelease(rx_context.rx_frame);
+    return NULL;
+}
+
+// деление файла на участки: граница участка сдвигается вперед до ближайшего флага FD
+// возвращает количество участков (0 - в файле нет флагов), leading - байт до первого флага
+static size_t CaptureSplit(size_t size, size_t chunk_size, size_t* leading)
+{
+    const uint8_t* end = capture_data + size;
+    const uint8_t* start = memchr(capture_data, HDLC_FD_FLAG, size);
+    size_t count = 0;
+
+    *leading = (start != NULL) ? (size_t)(start - capture_data) : size;
+    if(start == NULL)
+        return 0;
+
+    capture_chunks = calloc(size / chunk_size + 2, sizeof(capture_chunk_typedef));
+    if(capture_chunks == NULL)
+        return 0;
+
+    while(start != NULL)
+    {
+        const uint8_t* next = NULL;
+        capture_chunk_typedef* chunk = &capture_chunks[count++];
+
+        if((size_t)(end - start) > chunk_size)
+            next = memchr(start + chunk_size, HDLC_FD_FLAG, (size_t)(end - start) - chunk_size);
+
+        chunk->start = start;
+        chunk->end = (next != NULL) ? next + 1 : end;   // закрывающий флаг последнего кадра участка
+        start = next;
+    }
+    return count;
+}
+
+// вывод записей участка
+static void CapturePrint(FILE* out, const capture_chunk_typedef* chunk)
+{
+    for(size_t i = 0; i < chunk->frame_count; i++)
+    {
+        const capture_frame_typedef* frame = &chunk->frames[i];
+
+        if(frame->status != HDLC_RX_OK)
+        {
+            fprintf(out, "%llu,%u,,,,,,,%s\n", (unsigned long long)frame->offset, frame->wire_length,
+                    CaptureStatusName(frame->status));
+            continue;
+        }
+        fprintf(out, "%llu,%u,0x%02X,%c,0x%02X,%u,%u,%u,ok\n", (unsigned long long)frame->offset, frame->wire_length,
+                frame->address, frame->supervisory ? 'S' : 'I', frame->control, frame->ns, frame->nr, frame->info_length);
+    }
+}
+
+static void CaptureUsage(const char* program)
+{
+    fprintf(stderr,
+            "Usage: %s [options] FILE\n"
+            "  --threads N          decoding threads, up to %d (default: one per processor)\n"
+            "  --chunk-mb N         nominal chunk size in MiB (default %d)\n"
+            "  --output FILE        write frame records (CSV) to FILE instead of stdout\n"
+            "  --summary            print statistics only, no frame records\n",
+            program, CAPTURE_MAX_THREADS, CAPTURE_DEFAULT_CHUNK_MB);
+}
+
+static bool CaptureParseOptions(int argc, char** argv)
+{
+    capture_options = (capture_options_typedef){.chunk_mb = CAPTURE_DEFAULT_CHUNK_MB};
+
+    for(int i = 1; i < argc; i++)
+    {
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        if(strcmp(argv[i], "--summary") == 0)
+        {
+            capture_options.summary = true;
+            continue;
+        }
+        if(strncmp(argv[i], "--", 2) != 0)
+        {
+            if(capture_options.input != NULL)
+                return false;
+            capture_options.input = argv[i];
+            continue;
+        }
+        if(value == NULL)
+            return false;
+        if(strcmp(argv[i], "--threads") == 0)
+            capture_options.threads = (uint32_t)strtoul(value, NULL, 0);
+        else if(strcmp(argv[i], "--chunk-mb") == 0)
+            capture_options.chunk_mb = (uint32_t)strtoul(value, NULL, 0);
+        else if(strcmp(argv[i], "--output") == 0)
+            capture_options.output = value;
+        else
+            return false;
+        i++;
+    }
+    return capture_options.input != NULL && capture_options.chunk_mb > 0 && capture_options.threads <= CAPTURE_MAX_THREADS;
+}
+
+int main(int argc, char** argv)
+{
+    pthread_t threads[CAPTURE_MAX_THREADS];
+    uint64_t status_count[CAPTURE_STATUS_COUNT] = {0};
+    uint64_t frames = 0;
+    uint64_t info_bytes = 0;
+    uint32_t thread_count;
+    size_t leading = 0;
+    struct stat file_stat;
+    FILE* out = stdout;
+    uint64_t started;
+    double seconds;
+    int fd;
+
+    if(!CaptureParseOptions(argc, argv))
+    {
+        CaptureUsage(argv[0]);
+        return 2;
+    }
+    if(!CRC16_SelfTest())
+    {
+        fprintf(stderr, "CRC self-test failed!\n");
+        return 1;
+    }
+
+    fd = open(capture_options.input, O_RDONLY);
+    if(fd < 0 || fstat(fd, &file_stat) != 0)
+    {
+        perror(capture_options.input);
+        return 1;
+    }
+    if(capture_options.output != NULL && (out = fopen(capture_options.output, "w")) == NULL)
+    {
+        perror(capture_options.output);
+        return 1;
+    }
+
+    TRACE_SetLevel(TRACE_LEVEL_OFF);    // потоков разбора больше, чем буфферов журнала
+    SIMD_Init();
+    started = GetCurrentTimeUs();
+
+    if(file_stat.st_size > 0)
+    {
+        capture_data = mmap(NULL, (size_t)file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(capture_data == MAP_FAILED)
+        {
+            perror("mmap");
+            return 1;
+        }
+        madvise((void*)capture_data, (size_t)file_stat.st_size, MADV_SEQUENTIAL);
+        capture_chunk_count = CaptureSplit((size_t)file_stat.st_size, (size_t)capture_options.chunk_mb << 20, &leading);
+    }
+
+    // каждому потоку нужен свой буффер пула для информационного поля
+    thread_count = capture_options.threads ? capture_options.threads : (uint32_t)sysconf(_SC_NPROCESSORS_ONLN);
+    if(thread_count > CAPTURE_MAX_THREADS)
+        thread_count = CAPTURE_MAX_THREADS;
+    if(thread_count > FramePoolAvailable())
+        thread_count = FramePoolAvailable();
+    if(thread_count > capture_chunk_count)
+        thread_count = (uint32_t)capture_chunk_count;
+    capture_window = (size_t)thread_count * CAPTURE_WINDOW;
+
+    for(uint32_t i = 0; i < thread_count; i++)
+    {
+        if(pthread_create(&threads[i], NULL, CaptureWorker, NULL) != 0)
+        {
+            perror("pthread_create");
+            return 1;
+        }
+    }
+
+    if(!capture_options.summary)
+        fprintf(out, "offset,length,address,type,control,ns,nr,info,status\n");
+
+    // участки выводятся в порядке файла по мере разбора, память записей освобождается сразу
+    for(size_t i = 0; i < capture_chunk_count; i++)
+    {
+        capture_chunk_typedef* chunk = &capture_chunks[i];
+
+        pthread_mutex_lock(&capture_lock);
+        while(!chunk->done)
+            pthread_cond_wait(&capture_chunk_done, &capture_lock);
+        pthread_mutex_unlock(&capture_lock);
+
+        CapturePrint(out, chunk);
+        for(int status = 0; status < CAPTURE_STATUS_COUNT; status++)
+        {
+            status_count[status] += chunk->status_count[status];
+            frames += chunk->status_count[status];
+        }
+        info_bytes += chunk->info_bytes;
+        free(chunk->frames);
+        chunk->frames = NULL;
+
+        pthread_mutex_lock(&capture_lock);
+        capture_printed = i + 1;
+        pthread_cond_broadcast(&capture_chunk_printed);
+        pthread_mutex_unlock(&capture_lock);
+    }
+
+    for(uint32_t i = 0; i < thread_count; i++)
+        pthread_join(threads[i], NULL);
+    seconds = (double)(GetCurrentTimeUs() - started) / 1e6;
+
+    if(out != stdout)
+        fclose(out);
+    else
+        fflush(out);
+
+    fprintf(stderr, "%s: %llu bytes, %zu chunks, %u threads, %.3f s (%.1f MB/s)\n",
+            capture_options.input, (unsigned long long)file_stat.st_size, capture_chunk_count, thread_count,
+            seconds, (seconds > 0) ? (double)file_stat.st_size / seconds / 1e6 : 0.0);
+    fprintf(stderr, "frames: %llu, information bytes: %llu, bytes before first flag: %zu\n",
+            (unsigned long long)frames, (unsigned long long)info_bytes, leading);
+    for(int status = 0; status < CAPTURE_STATUS_COUNT; status++)
+        fprintf(stderr, "  %-16s %llu\n", CaptureStatusName((uint8_t)status), (unsigned long long)status_count[status]);
+
+    if(capture_data != NULL)
+        munmap((void*)capture_data, (size_t)file_stat.st_size);
+    free(capture_chunks);
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,150 @@
+#include "channel.h"
+#include "hdlc.h"
+#include <math.h>
+#include <stddef.h>
+
+uint32_t channel_count = 0;
+static channel_typedef* channel_list[CHANNEL_MAX];  // привязанные каналы
+
+// генератор xorshift64*
+static uint64_t ChannelRandom(channel_typedef* channel)
+{
+    channel->random ^= channel->random >> 12;
+    channel->random ^= channel->random << 25;
+    channel->random ^= channel->random >> 27;
+    return channel->random * 0x2545F4914F6CDD1DULL;
+}
+
+// равномерно распределенное число [0, 1)
+static double ChannelUniform(channel_typedef* channel)
+{
+    return (double)(ChannelRandom(channel) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// событие с вероятностью probability
+static bool ChannelEvent(channel_typedef* channel, double probability)
+{
+    return probability > 0.0 && ChannelUniform(channel) < probability;
+}
+
+// количество бит до следующей инверсии: вместо розыгрыша каждого бита - один розыгрыш на ошибку
+static uint64_t ChannelNextError(channel_typedef* channel)
+{
+    double rate = channel->profile.bit_error_rate;
+    double skip;
+
+    if(rate <= 0.0)
+        return UINT64_MAX;
+    if(rate >= 1.0)
+        return 0;
+    skip = floor(log(1.0 - ChannelUniform(channel)) / log(1.0 - rate));
+    return (skip >= 1.8e19) ? UINT64_MAX : (uint64_t)skip;
+}
+
+// инверсия бит байта по BER
+static uint8_t ChannelFlipBits(channel_typedef* channel, uint8_t byte)
+{
+    for(uint32_t bit = 0; bit < 8; bit++)
+    {
+        if(channel->bits_to_error != 0)
+        {
+            if(channel->bits_to_error != UINT64_MAX)
+                channel->bits_to_error--;
+            continue;
+        }
+        byte ^= (uint8_t)(1u << bit);
+        channel->stats.bit_errors++;
+        channel->bits_to_error = ChannelNextError(channel);
+    }
+    return byte;
+}
+
+// функция настройки канала (счетчики обнуляются)
+void CHANNEL_Init(channel_typedef* channel, const channel_profile_typedef* profile, uint64_t seed)
+{
+    channel->profile = *profile;
+    channel->random = seed ? seed : 1;              // нулевое состояние xorshift не меняется
+    channel->burst_left = 0;
+    channel->stats = (channel_stats_typedef){0};
+    channel->fifo = NULL;
+    channel->bits_to_error = ChannelNextError(channel);
+}
+
+// функция привязки канала к FIFO
+bool CHANNEL_Attach(channel_typedef* channel, fifo_typedef* fifo)
+{
+    if(channel_count >= CHANNEL_MAX)
+        return false;
+
+    channel->fifo = fifo;
+    channel_list[channel_count++] = channel;
+    return true;
+}
+
+// функция отвязки канала от FIFO
+void CHANNEL_Detach(channel_typedef* channel)
+{
+    for(uint32_t i = 0; i < channel_count; i++)
+    {
+        if(channel_list[i] == channel)
+        {
+            channel_list[i] = channel_list[--channel_count];
+            channel->fifo = NULL;
+            return;
+        }
+    }
+}
+
+// функция передачи байта через канал FIFO (у FIFO есть свободное место)
+void CHANNEL_Transmit(fifo_typedef* fifo, uint8_t byte)
+{
+    channel_typedef* channel = NULL;
+
+    for(uint32_t i = 0; i < channel_count; i++)
+    {
+        if(channel_list[i]->fifo == fifo)
+            channel = channel_list[i];
+    }
+    if(channel == NULL)
+    {
+        FifoWriteByte(fifo, byte);
+        return;
+    }
+
+    channel->stats.bytes++;
+    if(ChannelEvent(channel, channel->profile.drop_rate))
+    {
+        channel->stats.dropped++;
+        return;
+    }
+
+    // искаженный флаг не разделяет кадры: соседние кадры сливаются
+    if(byte == HDLC_FD_FLAG && ChannelEvent(channel, channel->profile.flag_error_rate))
+    {
+        byte = (uint8_t)(ChannelRandom(channel) >> 56);
+        if(byte == HDLC_FD_FLAG)
+            byte ^= 0x01;
+        channel->stats.flag_errors++;
+    }
+
+    if(channel->burst_left == 0 && channel->profile.burst_length > 0 && ChannelEvent(channel, channel->profile.burst_rate))
+    {
+        channel->burst_left = channel->profile.burst_length;
+        channel->stats.bursts++;
+    }
+    if(channel->burst_left > 0)
+    {
+        byte = (uint8_t)(ChannelRandom(channel) >> 56);
+        channel->burst_left--;
+    }
+
+    byte = ChannelFlipBits(channel, byte);
+    FifoWriteByte(fifo, byte);
+
+    // повтор только при свободном месте: FIFO не переполняется
+    if(!FifoIsFull(fifo) && ChannelEvent(channel, channel->profile.duplicate_rate))
+    {
+        FifoWriteByte(fifo, byte);
+        channel->stats.duplicated++;
+    }
+}
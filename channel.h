@@ -0,0 +1,69 @@
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "user.h"
+#include "fifo.h"
+
+// линия с искажениями: байты, которые HDLC_SendByte пишет в FIFO, проходят через канал, привязанный к этому FIFO
+// канал инвертирует биты (BER), теряет и повторяет байты, заменяет пачки байт и искажает флаги FD
+// псевдослучайная последовательность задается seed: один seed и профиль - одни и те же искажения
+// включается CHANNEL_FAULTS (user.h или параметр компилятора), без него HDLC_SendByte пишет в FIFO напрямую
+
+#define CHANNEL_MAX             4                   // привязанных каналов одновременно (по одному на FIFO)
+
+typedef struct                                      // профиль искажений (нулевой профиль - линия без искажений)
+{
+    double bit_error_rate;                          // вероятность инверсии каждого бита
+    double drop_rate;                               // вероятность потери байта
+    double duplicate_rate;                          // вероятность повтора байта
+    double burst_rate;                              // вероятность начала пачки ошибок на байт
+    uint32_t burst_length;                          // длина пачки: байты заменяются случайными
+    double flag_error_rate;                         // вероятность искажения флага FD
+} channel_profile_typedef;
+
+typedef struct                                      // счетчики искажений
+{
+    uint64_t bytes;                                 // байт передано в канал
+    uint64_t bit_errors;                            // инвертировано бит
+    uint64_t dropped;                               // потеряно байт
+    uint64_t duplicated;                            // повторено байт
+    uint64_t bursts;                                // пачек ошибок
+    uint64_t flag_errors;                           // искажено флагов FD
+} channel_stats_typedef;
+
+typedef struct                                      // канал
+{
+    channel_profile_typedef profile;                // профиль искажений
+    uint64_t random;                                // состояние генератора xorshift64*
+    uint64_t bits_to_error;                         // бит до следующей инверсии (геометрическое распределение)
+    uint32_t burst_left;                            // байт до конца текущей пачки
+    channel_stats_typedef stats;                    // счетчики искажений
+    fifo_typedef* fifo;                             // FIFO, к которому привязан канал (NULL - не привязан)
+} channel_typedef;
+
+extern uint32_t channel_count;                      // количество привязанных каналов
+
+// функция настройки канала (счетчики обнуляются)
+void CHANNEL_Init(channel_typedef* channel, const channel_profile_typedef* profile, uint64_t seed);
+
+// функция привязки канала к FIFO; false - привязано CHANNEL_MAX каналов
+bool CHANNEL_Attach(channel_typedef* channel, fifo_typedef* fifo);
+
+// функция отвязки канала от FIFO
+void CHANNEL_Detach(channel_typedef* channel);
+
+// функция передачи байта через канал FIFO (у FIFO есть свободное место)
+void CHANNEL_Transmit(fifo_typedef* fifo, uint8_t byte);
+
+// запись байта кадра в FIFO: без привязанных каналов - одна проверка счетчика
+static inline void CHANNEL_WriteByte(fifo_typedef* fifo, uint8_t byte)
+{
+    if(channel_count == 0)
+        FifoWriteByte(fifo, byte);
+    else
+        CHANNEL_Transmit(fifo, byte);
+}
+
+#endif
@@ -0,0 +1,215 @@
+#include "command.h"
+#include "hdlc.h"
+#include "simd.h"
+#include <stddef.h>
+#include <string.h>
+
+static uint32_t CommandAggregate(uint8_t* reply, const uint8_t* request, uint32_t length, void* arg);
+
+// инверсия байт
+static uint32_t CommandInvert(uint8_t* reply, const uint8_t* request, uint32_t length, void* arg)
+{
+    (void)arg;
+    SIMD_InvertBytes(reply, request, length);
+    return length;
+}
+
+// отражение байт
+static uint32_t CommandMirror(uint8_t* reply, const uint8_t* request, uint32_t length, void* arg)
+{
+    (void)arg;
+    SIMD_MirrorBytes(reply, request, length);
+    return length;
+}
+
+// ответ об ошибке: в таблице, чтобы ведущий принимал его как ответ; как запрос не выполняется
+static uint32_t CommandError(uint8_t* reply, const uint8_t* request, uint32_t length, void* arg)
+{
+    (void)request;
+    (void)length;
+    (void)arg;
+    reply[0] = CMD_ERROR;
+    reply[1] = COMMAND_STATUS_UNKNOWN;
+    return 2;
+}
+
+// таблица команд (встроенные команды зарегистрированы заранее)
+static command_entry_typedef command_table[COMMAND_TABLE_SIZE] =
+{
+    [CMD_INVERSING_BYTES] = {.handler = CommandInvert, .max_payload = HDLC_INFO_MAX_SIZE,
+                             .flags = COMMAND_IN_PLACE | COMMAND_BATCHABLE, .name = "invert"},
+    [CMD_MIRRORING_BYTES] = {.handler = CommandMirror, .max_payload = HDLC_INFO_MAX_SIZE,
+                             .flags = COMMAND_IN_PLACE | COMMAND_BATCHABLE, .name = "mirror"},
+    [CMD_AGGREGATE]       = {.handler = CommandAggregate, .max_payload = HDLC_INFO_MAX_SIZE, .name = "aggregate"},
+    [CMD_ERROR]           = {.handler = CommandError, .max_payload = HDLC_INFO_MAX_SIZE, .name = "error"},
+};
+
+// пакет команд: подкоманды выполняются по порядку, результат каждой дописывается в ответ
+// обрезанная подкоманда завершает разбор; после каждого результата, кроме последнего, в ответе остается место
+// для заголовка: подкоманда, ответ которой не помещается, возвращается с COMMAND_STATUS_TRUNCATED без данных
+static uint32_t CommandAggregate(uint8_t* reply, const uint8_t* request, uint32_t length, void* arg)
+{
+    uint32_t offset = 0;
+    uint32_t reply_length = 0;
+    command_item_typedef item;
+
+    (void)arg;
+    while(COMMAND_BatchNext(request, length, &offset, false, &item))
+    {
+        const command_entry_typedef* entry = COMMAND_Lookup(item.control);
+        uint8_t* result = &reply[reply_length];
+        uint32_t reserve = (offset < length) ? COMMAND_RESULT_HEADER_SIZE : 0;     // место для TRUNCATED следующей подкоманды
+
+        if(reply_length + COMMAND_RESULT_HEADER_SIZE + item.length + reserve > HDLC_INFO_MAX_SIZE)
+        {
+            result[0] = item.control;
+            result[1] = COMMAND_STATUS_TRUNCATED;
+            result[2] = 0;
+            result[3] = 0;
+            reply_length += COMMAND_RESULT_HEADER_SIZE;
+            break;
+        }
+
+        if(entry == NULL)
+            item.status = COMMAND_STATUS_UNKNOWN;
+        else if(!(entry->flags & COMMAND_BATCHABLE))
+            item.status = COMMAND_STATUS_NOT_BATCHABLE;
+        else if(item.length > entry->max_payload)
+            item.status = COMMAND_STATUS_TOO_LONG;
+        else
+            item.status = COMMAND_STATUS_OK;
+
+        // ответ подкоманды не длиннее запроса (COMMAND_BATCHABLE), у невыполненной подкоманды данных нет
+        item.length = (item.status == COMMAND_STATUS_OK) ?
+                      entry->handler(&result[COMMAND_RESULT_HEADER_SIZE], item.data, item.length, entry->arg) : 0;
+
+        result[0] = item.control;
+        result[1] = item.status;
+        result[2] = (uint8_t)(item.length >> 8);
+        result[3] = (uint8_t)item.length;
+        reply_length += COMMAND_RESULT_HEADER_SIZE + item.length;
+    }
+    return reply_length;
+}
+
+// функция регистрации команды (существующая запись заменяется)
+bool COMMAND_Register(uint8_t control, const command_entry_typedef* entry)
+{
+    if(entry->handler == NULL || entry->max_payload > HDLC_INFO_MAX_SIZE)
+        return false;
+#if HDLC_SEQ_MODULO == 0
+    if(control == HDLC_REJ_CONTROL)                 // управляющее поле занято S-кадром REJ
+        return false;
+#endif
+
+    command_table[control] = *entry;
+    return true;
+}
+
+// функция удаления команды из таблицы
+void COMMAND_Unregister(uint8_t control)
+{
+    command_table[control] = (command_entry_typedef){0};
+}
+
+// функция поиска команды
+const command_entry_typedef* COMMAND_Lookup(uint8_t control)
+{
+    return (command_table[control].handler != NULL) ? &command_table[control] : NULL;
+}
+
+// функция добавления подкоманды в пакет
+uint32_t COMMAND_BatchAppend(uint8_t* batch, uint32_t batch_length, uint32_t batch_size,
+                             uint8_t control, const uint8_t* data, uint32_t length)
+{
+    if(length > COMMAND_ITEM_MAX_LENGTH || batch_length > batch_size ||
+       batch_size - batch_length < COMMAND_ITEM_HEADER_SIZE + length)
+        return 0;
+
+    batch[batch_length] = control;
+    batch[batch_length + 1] = (uint8_t)(length >> 8);
+    batch[batch_length + 2] = (uint8_t)length;
+    memcpy(&batch[batch_length + COMMAND_ITEM_HEADER_SIZE], data, length);
+    return batch_length + COMMAND_ITEM_HEADER_SIZE + length;
+}
+
+// функция чтения подкоманды пакета
+bool COMMAND_BatchNext(const uint8_t* batch, uint32_t batch_length, uint32_t* offset, bool reply, command_item_typedef* item)
+{
+    uint32_t header = reply ? COMMAND_RESULT_HEADER_SIZE : COMMAND_ITEM_HEADER_SIZE;
+    const uint8_t* position = &batch[*offset];
+
+    if(*offset >= batch_length || batch_length - *offset < header)
+        return false;
+
+    item->control = position[0];
+    item->status = reply ? position[1] : COMMAND_STATUS_OK;
+    item->length = ((uint32_t)position[header - 2] << 8) | position[header - 1];
+    item->data = &position[header];
+    if(batch_length - *offset - header < item->length)
+        return false;
+
+    *offset += header + item->length;
+    return true;
+}
+
+// проверка пакета команд
+bool COMMAND_SelfTest(void)
+{
+    static uint8_t request[HDLC_INFO_MAX_SIZE];
+    static uint8_t reply[HDLC_INFO_MAX_SIZE];
+    static const uint8_t data[] = {0x00, 0x01, 0x02, 0x7E, 0x7D, 0xFF};
+    const command_entry_typedef* aggregate = COMMAND_Lookup(CMD_AGGREGATE);
+    command_item_typedef item;
+    uint32_t request_length = 0;
+    uint32_t reply_length;
+    uint32_t offset = 0;
+    uint32_t appended;
+    uint32_t count = 0;
+    uint32_t i;
+
+    if(aggregate == NULL)
+        return false;
+
+    // инверсия, отражение и команда, не выполняемая в пакете: результаты в том же порядке
+    request_length = COMMAND_BatchAppend(request, request_length, sizeof(request), CMD_INVERSING_BYTES, data, sizeof(data));
+    request_length = COMMAND_BatchAppend(request, request_length, sizeof(request), CMD_MIRRORING_BYTES, data, sizeof(data));
+    request_length = COMMAND_BatchAppend(request, request_length, sizeof(request), CMD_ERROR, data, sizeof(data));
+    if(request_length != 3 * (COMMAND_ITEM_HEADER_SIZE + sizeof(data)))
+        return false;
+
+    reply_length = aggregate->handler(reply, request, request_length, aggregate->arg);
+    if(!COMMAND_BatchNext(reply, reply_length, &offset, true, &item) || item.control != CMD_INVERSING_BYTES ||
+       item.status != COMMAND_STATUS_OK || item.length != sizeof(data))
+        return false;
+    for(i = 0; i < sizeof(data); i++)
+        if((item.data[i] ^ data[i]) != 0xFF)
+            return false;
+    if(!COMMAND_BatchNext(reply, reply_length, &offset, true, &item) || item.control != CMD_MIRRORING_BYTES ||
+       item.status != COMMAND_STATUS_OK || item.length != sizeof(data))
+        return false;
+    for(i = 0; i < sizeof(data); i++)
+        if(item.data[i] != data[sizeof(data) - 1 - i])
+            return false;
+    if(!COMMAND_BatchNext(reply, reply_length, &offset, true, &item) || item.control != CMD_ERROR ||
+       item.status != COMMAND_STATUS_NOT_BATCHABLE || item.length != 0)
+        return false;
+    if(COMMAND_BatchNext(reply, reply_length, &offset, true, &item) || offset != reply_length)
+        return false;
+
+    // пустые подкоманды на все информационное поле: заголовок ответа длиннее заголовка запроса,
+    // последняя выполненная подкоманда оставляет место для одной TRUNCATED
+    request_length = 0;
+    while((appended = COMMAND_BatchAppend(request, request_length, sizeof(request), CMD_INVERSING_BYTES, data, 0)) != 0)
+        request_length = appended;
+
+    reply_length = aggregate->handler(reply, request, request_length, aggregate->arg);
+    offset = 0;
+    while(COMMAND_BatchNext(reply, reply_length, &offset, true, &item) && item.status == COMMAND_STATUS_OK)
+        count++;
+    if(item.status != COMMAND_STATUS_TRUNCATED || offset != reply_length || reply_length > HDLC_INFO_MAX_SIZE ||
+       count != (HDLC_INFO_MAX_SIZE - COMMAND_RESULT_HEADER_SIZE) / COMMAND_RESULT_HEADER_SIZE)
+        return false;
+
+    return true;
+}
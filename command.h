@@ -0,0 +1,77 @@
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// таблица команд: 256 записей по значению управляющего поля I-кадра
+// проверка команды при приёме (HDLC_FrameCorrect) и выполнение (ProcessCommand) - одно обращение к таблице
+// собственные команды добавляются COMMAND_Register до запуска автоматов, без изменения hdlc.c
+
+#define COMMAND_TABLE_SIZE      256                 // по записи на каждое значение управляющего поля
+
+#define COMMAND_IN_PLACE        0x01                // обработчик допускает reply == request: ответ готовится в буффере принятого кадра
+#define COMMAND_BATCHABLE       0x02                // команда может выполняться в составе пакета команд (ответ не длиннее запроса)
+
+// пакет команд (CMD_AGGREGATE): информационное поле - подкоманды подряд, ответ - результаты в том же порядке
+// подкоманда запроса: команда, длина (старший байт первым), данные
+// подкоманда ответа: команда, результат (command_status_typedef), длина, данные ответа
+// если ответ очередной подкоманды не помещается, она возвращается с COMMAND_STATUS_TRUNCATED и пакет завершается
+#define COMMAND_ITEM_HEADER_SIZE    3               // заголовок подкоманды запроса
+#define COMMAND_RESULT_HEADER_SIZE  4               // заголовок подкоманды ответа
+#define COMMAND_ITEM_MAX_LENGTH     0xFFFF          // наибольшая длина данных подкоманды
+
+typedef enum                                        // результат выполнения подкоманды
+{
+    COMMAND_STATUS_OK = 0,                          // выполнена
+    COMMAND_STATUS_UNKNOWN,                         // команда не зарегистрирована
+    COMMAND_STATUS_NOT_BATCHABLE,                   // команда не выполняется в составе пакета
+    COMMAND_STATUS_TOO_LONG,                        // данные длиннее допустимых для команды
+    COMMAND_STATUS_TRUNCATED                        // не выполнена: ответ не поместился в информационное поле (следующие подкоманды не выполнялись)
+} command_status_typedef;
+
+typedef struct                                      // подкоманда пакета
+{
+    uint8_t control;                                // команда
+    uint8_t status;                                 // результат (только в ответе)
+    const uint8_t* data;                            // данные подкоманды (внутри информационного поля)
+    uint32_t length;                                // длина данных
+} command_item_typedef;
+
+// обработчик команды: запись ответа в reply по информационному полю request длиной length
+// возвращает длину ответа (не больше HDLC_INFO_MAX_SIZE)
+typedef uint32_t (*command_handler_typedef)(uint8_t* reply, const uint8_t* request, uint32_t length, void* arg);
+
+typedef struct                                      // запись таблицы команд
+{
+    command_handler_typedef handler;                // обработчик (NULL - команда не зарегистрирована)
+    uint32_t max_payload;                           // максимальная длина информационного поля запроса
+    uint8_t flags;                                  // COMMAND_IN_PLACE, COMMAND_BATCHABLE
+    void* arg;                                      // аргумент обработчика
+    const char* name;                               // имя команды
+} command_entry_typedef;
+
+// функция регистрации команды (существующая запись заменяется)
+// false - нет обработчика, длина больше HDLC_INFO_MAX_SIZE или поле занято REJ (HDLC_REJ_CONTROL при HDLC_SEQ_MODULO 0)
+bool COMMAND_Register(uint8_t control, const command_entry_typedef* entry);
+
+// функция удаления команды из таблицы
+void COMMAND_Unregister(uint8_t control);
+
+// функция поиска команды (NULL - команда не зарегистрирована)
+const command_entry_typedef* COMMAND_Lookup(uint8_t control);
+
+// функция добавления подкоманды в пакет batch (batch_length - занято, batch_size - размер буффера)
+// возвращает новую длину пакета или 0, если подкоманда не помещается
+uint32_t COMMAND_BatchAppend(uint8_t* batch, uint32_t batch_length, uint32_t batch_size,
+                             uint8_t control, const uint8_t* data, uint32_t length);
+
+// функция чтения подкоманды пакета с позиции *offset (reply - пакет ответа с результатами)
+// false - пакет закончился или подкоманда обрезана
+bool COMMAND_BatchNext(const uint8_t* batch, uint32_t batch_length, uint32_t* offset, bool reply, command_item_typedef* item);
+
+// проверка пакета команд: запрос из COMMAND_BatchAppend выполняется CMD_AGGREGATE и разбирается как ответ,
+// подкоманда, ответ которой не помещается в информационное поле, возвращается с COMMAND_STATUS_TRUNCATED
+bool COMMAND_SelfTest(void);
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef CRC_H
+#define CRC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "user.h"
+
+#define CRC16_INIT              0xFFFF                  // начальное значение CRC-CCITT для HDLC
+#define CRC16_XOROUT            0xFFFF                  // финальное инвертирование для HDLC
+#define CRC16_POLY              0x1021                  // полином CRC-CCITT
+
+#define CRC_ENGINE_BITWISE      0                       // побитовый расчет (эталонная реализация)
+#define CRC_ENGINE_TABLE        1                       // табличный расчет (256 значений, байт за итерацию)
+#define CRC_ENGINE_SLICE8       2                       // slicing-by-8 (8 таблиц, 8 байт за итерацию)
+
+#ifndef CRC_ENGINE
+#define CRC_ENGINE              CRC_ENGINE_SLICE8       // реализация по умолчанию, если не выбрана в user.h
+#endif
+
+extern const uint16_t crc16_table[8][256];              // таблицы CRC: [0] - табличный расчет, [0..7] - slicing-by-8
+
+// побитовый расчет CRC (эталонная реализация)
+uint16_t CRC16_UpdateBitwise(uint16_t crc, const uint8_t* data, size_t length);
+
+// табличный расчет CRC (один байт за итерацию)
+uint16_t CRC16_UpdateTable(uint16_t crc, const uint8_t* data, size_t length);
+
+// расчет CRC методом slicing-by-8 (восемь байт за итерацию)
+uint16_t CRC16_UpdateSlice8(uint16_t crc, const uint8_t* data, size_t length);
+
+// расчет CRC выбранной при сборке реализацией (CRC_ENGINE)
+uint16_t CRC16_Update(uint16_t crc, const uint8_t* data, size_t length);
+
+// самопроверка: сравнение всех реализаций с эталонной (возвращает 1 - успешно, 0 - ошибка)
+bool CRC16_SelfTest(void);
+
+// добавление одного байта к CRC (табличный расчет)
+static inline uint16_t CRC16_UpdateByte(uint16_t crc, uint8_t byte)
+{
+    return (uint16_t)((crc << 8) ^ crc16_table[0][(uint8_t)((crc >> 8) ^ byte)]);
+}
+
+#endif
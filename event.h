@@ -0,0 +1,75 @@
+#ifndef EVENT_H
+#define EVENT_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+// событие для пробуждения потока: поток засыпает на futex, пока счётчик событий не изменится
+// (только LINUX; используется в THREADED_MODE, а для процессов с общей памятью - функции ...Shared)
+
+typedef struct
+{
+    _Atomic uint32_t sequence;          // счётчик событий (слово futex)
+    _Atomic uint32_t waiters;           // количество потоков, ожидающих событие
+} event_typedef;
+
+// функция получения текущего значения счётчика (вызывается до проверки условий ожидания)
+static inline uint32_t EventPrepare(event_typedef* event)
+{
+    return atomic_load_explicit(&event->sequence, memory_order_acquire);
+}
+
+// ожидание на futex с заданной операцией (частный futex процесса или общий для разделяемой памяти)
+static inline void EventFutexWait(event_typedef* event, uint32_t sequence, uint32_t timeout_us, int operation)
+{
+    struct timespec ts = {timeout_us / 1000000, (long)(timeout_us % 1000000) * 1000};
+
+    // увеличение waiters до проверки sequence не дает пропустить EventSignal
+    atomic_fetch_add(&event->waiters, 1);
+    if(atomic_load(&event->sequence) == sequence)
+    {
+        syscall(SYS_futex, &event->sequence, operation, sequence, timeout_us ? &ts : NULL, NULL, 0);
+    }
+    atomic_fetch_sub(&event->waiters, 1);
+}
+
+// оповещение на futex с заданной операцией (системный вызов только если кто-то ждет)
+static inline void EventFutexWake(event_typedef* event, int operation)
+{
+    atomic_fetch_add(&event->sequence, 1);
+    if(atomic_load(&event->waiters) != 0)
+    {
+        syscall(SYS_futex, &event->sequence, operation, INT_MAX, NULL, NULL, 0);
+    }
+}
+
+// функция ожидания события, произошедшего после EventPrepare (timeout_us = 0 - без ограничения)
+static inline void EventWait(event_typedef* event, uint32_t sequence, uint32_t timeout_us)
+{
+    EventFutexWait(event, sequence, timeout_us, FUTEX_WAIT_PRIVATE);
+}
+
+// функция оповещения о событии (системный вызов только если кто-то ждет)
+static inline void EventSignal(event_typedef* event)
+{
+    EventFutexWake(event, FUTEX_WAKE_PRIVATE);
+}
+
+// функция ожидания события в памяти, разделяемой между процессами
+static inline void EventWaitShared(event_typedef* event, uint32_t sequence, uint32_t timeout_us)
+{
+    EventFutexWait(event, sequence, timeout_us, FUTEX_WAIT);
+}
+
+// функция оповещения о событии в памяти, разделяемой между процессами
+static inline void EventSignalShared(event_typedef* event)
+{
+    EventFutexWake(event, FUTEX_WAKE);
+}
+
+#endif
@@ -5,9 +5,170 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
+#include "user.h"
 
-#define FIFO_SIZE       8           // размер FIFO
+#ifdef FIFO_SPSC
+#include <stdatomic.h>
+#endif
 
+#ifndef FIFO_SIZE
+#define FIFO_SIZE       8           // размер FIFO (может задаваться при сборке, например для бенчмарков)
+#endif
+
+typedef struct                          // непрерывный участок буффера FIFO
+{
+    uint8_t* data;                      // начало участка
+    uint32_t length;                    // длина участка
+} fifo_region_typedef;
+
+typedef struct                          // участок FIFO с учетом перехода через конец буффера
+{
+    fifo_region_typedef region[2];      // второй участок начинается с начала буффера (может быть пустым)
+    uint32_t length;                    // суммарная длина участков
+} fifo_span_typedef;
+
+#ifdef FIFO_SPSC
+/*-------------------------------------------------SPSC FIFO (C11 atomics)-------------------------------------------------------------------------------------*/
+// один поток пишет, другой читает; индексы свободно растут и переводятся в позицию маской
+
+#if (FIFO_SIZE & (FIFO_SIZE - 1)) != 0
+#error "FIFO_SIZE должен быть степенью двойки при FIFO_SPSC"
+#endif
+
+#define FIFO_MASK           (FIFO_SIZE - 1)     // маска позиции в буффере
+#define FIFO_CACHE_LINE     64                  // размер кэш-линии (индексы писателя и читателя на разных линиях)
+
+typedef struct                                              // структура FIFO
+{
+    _Alignas(FIFO_CACHE_LINE) _Atomic uint32_t write_index; // индекс для записи в FIFO (изменяет только писатель)
+    _Atomic uint32_t discard_index;                         // данные до этого индекса сброшены писателем (FifoIndexReset)
+    _Alignas(FIFO_CACHE_LINE) _Atomic uint32_t read_index;  // индекс для чтения из FIFO (изменяет только читатель)
+    _Alignas(FIFO_CACHE_LINE) uint8_t buffer[FIFO_SIZE];    // буффер FIFO
+} fifo_typedef;
+
+// функция инициализации FIFO
+static inline void FifoInit(fifo_typedef* fifo)   
+{
+    atomic_store_explicit(&fifo->write_index, 0, memory_order_relaxed);
+    atomic_store_explicit(&fifo->discard_index, 0, memory_order_relaxed);
+    atomic_store_explicit(&fifo->read_index, 0, memory_order_relaxed);
+    memset(fifo->buffer, 0, FIFO_SIZE);
+}
+
+// функция проверки FIFO на полноту (вызывает писатель)
+static inline bool FifoIsFull(fifo_typedef* fifo)      
+{
+    uint32_t write_index = atomic_load_explicit(&fifo->write_index, memory_order_relaxed);
+    uint32_t read_index = atomic_load_explicit(&fifo->read_index, memory_order_acquire);
+
+    return (write_index - read_index) == FIFO_SIZE;                 // если полон, то возвращается 1
+}
+
+// индекс чтения с учетом сброса, выполненного писателем (вызывает читатель)
+static inline uint32_t FifoConsumerIndex(fifo_typedef* fifo)
+{
+    uint32_t read_index = atomic_load_explicit(&fifo->read_index, memory_order_relaxed);
+    uint32_t discard_index = atomic_load_explicit(&fifo->discard_index, memory_order_acquire);
+
+    if((int32_t)(discard_index - read_index) > 0)
+    {
+        read_index = discard_index;
+        atomic_store_explicit(&fifo->read_index, read_index, memory_order_release);
+    }
+    return read_index;
+}
+
+// проверка FIFO на отсутствие данных (вызывает читатель)
+static inline bool FifoIsEmpty(fifo_typedef* fifo)      
+{
+    uint32_t read_index = FifoConsumerIndex(fifo);
+
+    return atomic_load_explicit(&fifo->write_index, memory_order_acquire) == read_index;   // если пуст, то возвращается 1
+}
+
+// функция записи байта в FIFO
+static inline void FifoWriteByte(fifo_typedef* fifo, uint8_t data)    
+{
+    uint32_t write_index = atomic_load_explicit(&fifo->write_index, memory_order_relaxed);
+
+    fifo->buffer[write_index & FIFO_MASK] = data;
+    atomic_store_explicit(&fifo->write_index, write_index + 1, memory_order_release);   // байт виден читателю после записи
+}
+
+// функция чтения байта из FIFO в буффер приёмника (после проверки FifoIsEmpty)
+static inline void FifoReadByte(fifo_typedef* fifo, uint8_t* rx_data)     
+{
+    // сброс учитывается только в FifoIsEmpty: сброшенный после проверки байт ещё не перезаписан писателем
+    uint32_t read_index = atomic_load_explicit(&fifo->read_index, memory_order_relaxed);
+
+    *rx_data = fifo->buffer[read_index & FIFO_MASK];
+    atomic_store_explicit(&fifo->read_index, read_index + 1, memory_order_release);     // место освобождается после чтения
+}
+
+// функция сброса непрочитанных данных (вызывает писатель; читатель пропустит их при следующем обращении)
+static inline void FifoIndexReset(fifo_typedef* fifo)
+{
+    uint32_t write_index = atomic_load_explicit(&fifo->write_index, memory_order_relaxed);
+
+    atomic_store_explicit(&fifo->discard_index, write_index, memory_order_release);
+}
+
+// свободное место для записи (вызывает писатель)
+static inline uint32_t FifoFreeSpace(fifo_typedef* fifo)
+{
+    uint32_t write_index = atomic_load_explicit(&fifo->write_index, memory_order_relaxed);
+
+    return FIFO_SIZE - (write_index - atomic_load_explicit(&fifo->read_index, memory_order_acquire));
+}
+
+// количество непрочитанных байт (вызывает читатель)
+static inline uint32_t FifoUsedSpace(fifo_typedef* fifo)
+{
+    uint32_t read_index = FifoConsumerIndex(fifo);
+
+    return atomic_load_explicit(&fifo->write_index, memory_order_acquire) - read_index;
+}
+
+// позиции записи и чтения в буффере
+static inline uint32_t FifoWritePosition(fifo_typedef* fifo)
+{
+    return atomic_load_explicit(&fifo->write_index, memory_order_relaxed) & FIFO_MASK;
+}
+
+static inline uint32_t FifoReadPosition(fifo_typedef* fifo)
+{
+    return atomic_load_explicit(&fifo->read_index, memory_order_relaxed) & FIFO_MASK;
+}
+
+// подтверждение записи count байт (данные становятся видны читателю)
+static inline void FifoWriteCommit(fifo_typedef* fifo, uint32_t count)
+{
+    uint32_t write_index = atomic_load_explicit(&fifo->write_index, memory_order_relaxed);
+
+    atomic_store_explicit(&fifo->write_index, write_index + count, memory_order_release);
+}
+
+// освобождение count прочитанных байт
+static inline void FifoReadConsume(fifo_typedef* fifo, uint32_t count)
+{
+    uint32_t read_index = atomic_load_explicit(&fifo->read_index, memory_order_relaxed);
+
+    atomic_store_explicit(&fifo->read_index, read_index + count, memory_order_release);
+}
+
+// счётчики записанных и прочитанных байт (для отладки и обнаружения изменений)
+static inline uint32_t FifoWriteCounter(fifo_typedef* fifo)
+{
+    return atomic_load_explicit(&fifo->write_index, memory_order_relaxed);
+}
+
+static inline uint32_t FifoReadCounter(fifo_typedef* fifo)
+{
+    return atomic_load_explicit(&fifo->read_index, memory_order_relaxed);
+}
+
+#else
+/*-------------------------------------------------FIFO для одного потока-------------------------------------------------------------------------------------*/
 
 typedef struct                          // структура FIFO
 {
@@ -16,6 +177,10 @@ typedef struct                          // структура FIFO
     uint16_t read_index;                 // индекс для чтения из FIFO
 } fifo_typedef;
 
+// индексы переполняются через 65536: позиция index % FIFO_SIZE остается верной, только если FIFO_SIZE делит 65536,
+// а заполненность write_index - read_index отличает полный FIFO от пустого, только если FIFO_SIZE меньше 65536
+_Static_assert((65536 % FIFO_SIZE) == 0 && FIFO_SIZE <= 32768, "FIFO_SIZE должен делить 65536 и быть не больше 32768");
+
 // функция инициализации FIFO
 static inline void FifoInit(fifo_typedef* fifo)   
 {
@@ -57,26 +222,116 @@ static inline void FifoIndexReset(fifo_typedef* fifo)
     fifo->write_index = fifo->read_index;
 }
 
-// отладочная функция
-static inline void DebugFifoState(fifo_typedef* fifo, const char* fifo_name)
+// свободное место для записи (индексы uint16_t, поэтому FIFO_SIZE должен делить 65536)
+static inline uint32_t FifoFreeSpace(fifo_typedef* fifo)
 {
-    printf("%s FIFO: [", fifo_name);
-    for(int i = 0; i < FIFO_SIZE; i++) {
+    return FIFO_SIZE - (uint16_t)(fifo->write_index - fifo->read_index);
+}
 
-        uint8_t read_pos=fifo->read_index%FIFO_SIZE;
-        uint8_t write_pos=fifo->write_index%FIFO_SIZE;
+// количество непрочитанных байт
+static inline uint32_t FifoUsedSpace(fifo_typedef* fifo)
+{
+    return (uint16_t)(fifo->write_index - fifo->read_index);
+}
 
-        if(i == read_pos && i == write_pos) {
-            printf(" RW:%02X", fifo->buffer[i]);  
-        } else if(i == read_pos) {
-            printf(" R:%02X", fifo->buffer[i]);   
-        } else if(i == write_pos) {
-            printf(" W:%02X", fifo->buffer[i]);   
-        } else {
-            printf(" %02X", fifo->buffer[i]);
-        }
-    }
-    printf(" ]\n");
+// позиции записи и чтения в буффере
+static inline uint32_t FifoWritePosition(fifo_typedef* fifo)
+{
+    return fifo->write_index % FIFO_SIZE;
+}
+
+static inline uint32_t FifoReadPosition(fifo_typedef* fifo)
+{
+    return fifo->read_index % FIFO_SIZE;
+}
+
+// подтверждение записи count байт
+static inline void FifoWriteCommit(fifo_typedef* fifo, uint32_t count)
+{
+    fifo->write_index += count;
+}
+
+// освобождение count прочитанных байт
+static inline void FifoReadConsume(fifo_typedef* fifo, uint32_t count)
+{
+    fifo->read_index += count;
+}
+
+// счётчики записанных и прочитанных байт (для отладки и обнаружения изменений)
+static inline uint32_t FifoWriteCounter(fifo_typedef* fifo)
+{
+    return fifo->write_index;
+}
+
+static inline uint32_t FifoReadCounter(fifo_typedef* fifo)
+{
+    return fifo->read_index;
+}
+#endif
+
+/*-------------------------------------------------Блочные операции-------------------------------------------------------------------------------------------*/
+
+// разбиение участка буффера длиной length, начиная с position, на части до и после конца буффера
+static inline void FifoMakeSpan(fifo_typedef* fifo, uint32_t position, uint32_t length, fifo_span_typedef* span)
+{
+    uint32_t first = FIFO_SIZE - position;          // место до конца буффера
+
+    if(first > length)
+        first = length;
+
+    span->region[0].data = &fifo->buffer[position];
+    span->region[0].length = first;
+    span->region[1].data = fifo->buffer;
+    span->region[1].length = length - first;
+    span->length = length;
+}
+
+// резервирование места для записи (не более max_length байт); возвращает зарезервированную длину
+// записанное в span становится данными FIFO только после FifoWriteCommit
+static inline uint32_t FifoWriteReserve(fifo_typedef* fifo, uint32_t max_length, fifo_span_typedef* span)
+{
+    uint32_t length = FifoFreeSpace(fifo);
+
+    if(length > max_length)
+        length = max_length;
+    FifoMakeSpan(fifo, FifoWritePosition(fifo), length, span);
+    return length;
+}
+
+// доступ к непрочитанным данным без их извлечения (не более max_length байт); возвращает доступную длину
+// данные освобождаются вызовом FifoReadConsume
+static inline uint32_t FifoReadPeek(fifo_typedef* fifo, uint32_t max_length, fifo_span_typedef* span)
+{
+    uint32_t length = FifoUsedSpace(fifo);
+
+    if(length > max_length)
+        length = max_length;
+    FifoMakeSpan(fifo, FifoReadPosition(fifo), length, span);
+    return length;
+}
+
+// запись до length байт; возвращает количество записанных
+static inline uint32_t FifoWrite(fifo_typedef* fifo, const uint8_t* data, uint32_t length)
+{
+    fifo_span_typedef span;
+
+    length = FifoWriteReserve(fifo, length, &span);
+    memcpy(span.region[0].data, data, span.region[0].length);
+    memcpy(span.region[1].data, &data[span.region[0].length], span.region[1].length);
+    FifoWriteCommit(fifo, length);
+    return length;
+}
+
+// чтение до length байт; возвращает количество прочитанных
+static inline uint32_t FifoRead(fifo_typedef* fifo, uint8_t* data, uint32_t length)
+{
+    fifo_span_typedef span;
+
+    length = FifoReadPeek(fifo, length, &span);
+    memcpy(data, span.region[0].data, span.region[0].length);
+    memcpy(&data[span.region[0].length], span.region[1].data, span.region[1].length);
+    FifoReadConsume(fifo, length);
+    return length;
 }
 
 #endif
\ No newline at end of file
@@ -1,30 +1,119 @@
 #include "fsm.h"
-#include <stdio.h>
+#include "trace.h"
+#include "command.h"
 
 fsm_state_master_typedef master_state = MASTER_PREPARE_STATE;     // инициализация мастера в отправку
-fsm_state_slave_typedef slave_state = SLAVE_WAITING_CMD_STATE;    // инициализация слейва в ожидание флага
+slave_node_typedef slave_nodes[HDLC_SLAVE_COUNT];                // ведомые узлы на шине (инициализируются при первом вызове FSM_Slave)
 
-timeout_typedef master_timeout = {0};
+timer_wheel_typedef master_timers = {0};
+rto_typedef master_rto[HDLC_SLAVE_COUNT];
+static metrics_link_typedef* master_metrics = NULL;              // метрики ведущего (задаются при первом вызове FSM_Master)
 
+// учет кадров ведущего в метриках
+static void FSM_MasterAttachMetrics(void)
+{
+    master_metrics = METRICS_Link(HDLC_MASTER_ADDR);
+    master_tx_context.metrics = master_metrics;
+    master_rx_context.metrics = master_metrics;
+}
+
+// обработчик истечения таймера ведущего: флаг проверяется автоматом в его состоянии
+static void FSM_MasterTimerExpired(timer_typedef* timer, void* arg)
+{
+    (void)timer;
+    *(bool*)arg = true;
+}
+
+// запуск таймера ожидания ответа (подтверждения) ведущего на текущий RTO ведомого
+static void FSM_MasterStartTimer(timer_typedef* timer, bool* expired, const rto_typedef* rto)
+{
+    *expired = false;
+    TIMER_Start(&master_timers, timer, RTO_Timeout(rto), FSM_MasterTimerExpired, expired);
+}
+
+// учет времени ответа ведомого, кадр которому передан в sent_us
+static void FSM_MasterMeasureRtt(rto_typedef* rto, uint64_t sent_us)
+{
+    uint64_t now = GetCurrentTimeUs();
+
+    RTO_Sample(rto, (now > sent_us) ? now - sent_us : 0);
+    METRICS_Record(master_metrics, METRICS_HIST_REPLY, (now > sent_us) ? (now - sent_us) * 1000u : 0);
+    TRACE(TRACE_MASTER_RTT, HDLC_MASTER_ADDR, RTO_SmoothedRtt(rto), RTO_Timeout(rto));
+}
+
+// функция подготовки информационного поля ведущего: при CMD_AGGREGATE - пакет инверсии и отражения USER_INFO_PACK
+void FSM_MasterPreparePayload(void)
+{
+    static const uint8_t info[HDLC_INFO_SIZE] = USER_INFO_PACK;
+    uint8_t* batch = master_tx_context.internal_tx_buffer;
+    uint32_t length;
+
+    if(USER_COMMAND != CMD_AGGREGATE)
+        return;
+
+    length = COMMAND_BatchAppend(batch, 0, HDLC_INFO_MAX_SIZE, CMD_INVERSING_BYTES, info, HDLC_INFO_SIZE);
+    if(length != 0)
+        length = COMMAND_BatchAppend(batch, length, HDLC_INFO_MAX_SIZE, CMD_MIRRORING_BYTES, info, HDLC_INFO_SIZE);
+    master_tx_context.internal_tx_length = length;
+}
+
+// разбор информационного поля ответа: ошибка выполнения и результаты подкоманд пакета - в журнал
+static void FSM_MasterReply(uint8_t control, const uint8_t* payload, uint32_t length)
+{
+    uint32_t offset = 0;
+    command_item_typedef item;
+
+    if(control == CMD_ERROR && length >= 2)
+        TRACE(TRACE_MASTER_COMMAND_ERROR, HDLC_MASTER_ADDR, payload[0], payload[1]);
+    if(control == CMD_AGGREGATE)
+    {
+        while(COMMAND_BatchNext(payload, length, &offset, true, &item))
+            TRACE(TRACE_MASTER_BATCH_RESULT, HDLC_MASTER_ADDR, item.control, item.status);
+        if(offset != length)
+            TRACE(TRACE_MASTER_BATCH_MALFORMED, HDLC_MASTER_ADDR, offset, length);
+    }
+    TRACE(TRACE_RX_PAYLOAD, HDLC_MASTER_ADDR, length, TRACE_PayloadHead(payload, length));
+}
+
+#if HDLC_SEQ_MODULO == 0
 // конечный автомат ведущего
 void FSM_Master(void)
 {
     static bool frame_sent=false;                   // флаг отправленного сообщения
+    static int poll_index=0;                        // номер опрашиваемого адреса в цикле опроса
+    static uint8_t target_addr=HDLC_SLAVE_ADDR;     // адрес текущего кадра
+    static timer_typedef reply_timer;               // таймер ожидания ответа
+    static bool reply_expired=false;                // ответ не получен за RTO ведомого
+    static uint64_t sent_us=0;                      // время окончания передачи кадра
+    static bool resend=false;                       // получен REJ: кадр повторяется тому же ведомому
+    static uint32_t reject_count=0;                 // повторов текущего кадра по REJ подряд
+
+    if(master_metrics == NULL)
+        FSM_MasterAttachMetrics();
+    TIMER_Advance(&master_timers, GetCurrentTimeUs());
     
     switch(master_state)
     {
         case MASTER_PREPARE_STATE:
 
+            // выбор адреса: ведомые по кругу, затем (если включено) широковещательный кадр
+            if(!resend)
+            {
+                target_addr = (poll_index < HDLC_SLAVE_COUNT) ? (uint8_t)(HDLC_SLAVE_ADDR + poll_index) : HDLC_BROADCAST_ADDR;
+                poll_index = (poll_index + 1) % MASTER_POLL_COUNT;
+                reject_count = 0;
+            }
+            resend = false;
+
             // подготовка к началу общения
-            printf("----------------------------------------------------------\n");
-            printf("Master:\tPreparing message with command: 0x%02X to unit: 0x%02X \n", USER_COMMAND, HDLC_SLAVE_ADDR);
+            TRACE(TRACE_MASTER_PREPARE, HDLC_MASTER_ADDR, USER_COMMAND, target_addr);
 
             FifoIndexReset(&fifo_mts);
-            HDLC_TxContextInit(&master_tx_context, HDLC_SLAVE_ADDR, USER_COMMAND);
+            HDLC_TxContextInit(&master_tx_context, target_addr, USER_COMMAND);
             HDLC_RxContextInit(&master_rx_context);
             
             frame_sent=false;
-            printf("Master:\tStart transmitting...\n");
+            TRACE(TRACE_TX_START, HDLC_MASTER_ADDR, 0, 0);
             master_state=MASTER_TX_STATE;
             break;
 
@@ -39,26 +128,31 @@ void FSM_Master(void)
                     if(master_tx_context.tx_stage==TX_STAGE_COMPLETED)
                     {
                         frame_sent=true;
-                        printf("Master:\tFrame sent completely!\n");
+                        TRACE(TRACE_TX_DONE, HDLC_MASTER_ADDR, 0, 0);
                     }
                 }
                 else
                 {
-                    printf("Master:\tFIFO is full, waiting...\n");
+                    TRACE(TRACE_FIFO_FULL, HDLC_MASTER_ADDR, 0, 0);
+                    METRICS_Add(master_metrics, METRICS_FIFO_FULL, 1);
                 }
             }
             else
             {
                 // отладочная информация
-                printf("Master:\tTransmitted information:\t");
-                for(int i=0; i<HDLC_INFO_SIZE; i++)
+                TRACE(TRACE_TX_PAYLOAD, HDLC_MASTER_ADDR, master_tx_context.tx_data.info_length,
+                      TRACE_PayloadHead(master_tx_context.tx_data.information, master_tx_context.tx_data.info_length));
+
+                // на широковещательный кадр ответа нет
+                if(target_addr == HDLC_BROADCAST_ADDR)
                 {
-                    printf("%02X ", master_tx_context.tx_data.information[i]);
+                    master_state=MASTER_PREPARE_STATE;
+                    break;
                 }
-                printf("\n");
 
-                printf("Master:\tWaiting for reply from unit 0x%02X...\n", master_tx_context.tx_data.address);
-                SetTimeout(&master_timeout, MASTER_WAIT_REPLY_MS);
+                TRACE(TRACE_MASTER_WAIT_REPLY, HDLC_MASTER_ADDR, master_tx_context.tx_data.address, 0);
+                sent_us = GetCurrentTimeUs();
+                FSM_MasterStartTimer(&reply_timer, &reply_expired, &master_rto[target_addr - HDLC_SLAVE_ADDR]);
                 master_state=MASTER_WAITING_REPLY_STATE;
             }
             break;
@@ -67,21 +161,24 @@ void FSM_Master(void)
 
             // ожидаем флаг начала передачи от ведомого
             if (!FifoIsEmpty(&fifo_stm))
-                HDLC_ReceiveByte(&master_rx_context, &fifo_stm, HDLC_MASTER_ADDR, "Master");
+                HDLC_ReceiveByte(&master_rx_context, &fifo_stm, HDLC_MASTER_ADDR);
             else
-                printf("Master:\tFIFO is empty, waiting...\n");
+            {
+                TRACE(TRACE_FIFO_EMPTY, HDLC_MASTER_ADDR, 0, 0);
+                METRICS_Add(master_metrics, METRICS_FIFO_EMPTY, 1);
+            }
 
+            // таймер не останавливается: ответ, потерявший флаг окончания, завершается таймаутом
             if(master_rx_context.fd_received && !master_rx_context.frame_assembled)
-            {
                 master_state=MASTER_RX_STATE;
-                ClearTimeout(&master_timeout);
-            }
 
             // проверка на таймаута
-            if (CheckTimeoutPassed(&master_timeout) && master_timeout.timeout_duration!=0)
+            if (reply_expired)
             {
                 master_state = MASTER_PREPARE_STATE;
-                printf("Master:\tNo reply received. Sending again...\n");
+                RTO_Backoff(&master_rto[target_addr - HDLC_SLAVE_ADDR]);
+                METRICS_Add(master_metrics, METRICS_TIMEOUTS, 1);
+                TRACE(TRACE_MASTER_NO_REPLY, HDLC_MASTER_ADDR, 0, 0);
             }
             break;
 
@@ -89,168 +186,579 @@ void FSM_Master(void)
             
             // приём ответа от ведомого 
             if (!FifoIsEmpty(&fifo_stm)) 
-                HDLC_ReceiveByte(&master_rx_context, &fifo_stm, HDLC_MASTER_ADDR, "Master");
+                HDLC_ReceiveByte(&master_rx_context, &fifo_stm, HDLC_MASTER_ADDR);
             else
-                printf("Master:\tFIFO is empty, waiting...\n");
+            {
+                TRACE(TRACE_FIFO_EMPTY, HDLC_MASTER_ADDR, 0, 0);
+                METRICS_Add(master_metrics, METRICS_FIFO_EMPTY, 1);
+            }
 
             if(master_rx_context.frame_assembled && master_rx_context.frame_correct)
             {
+                TIMER_Cancel(&master_timers, &reply_timer);
                 master_state=MASTER_PROCESSING_STATE;
-                printf("Master:\tFrame received correctly!\n");
             }
             else if(master_rx_context.frame_assembled && !master_rx_context.frame_correct)
             {
-                printf("Master:\tFrame is incorrect!\n");
+                TIMER_Cancel(&master_timers, &reply_timer);
+                TRACE(TRACE_RX_FRAME_FAILED, HDLC_MASTER_ADDR, 0, 0);
                 HDLC_RxContextInit(&master_rx_context);
                 master_state = MASTER_PREPARE_STATE;
             }
+            else if(reply_expired)
+            {
+                // начало ответа принято, конец потерян в линии
+                master_state = MASTER_PREPARE_STATE;
+                RTO_Backoff(&master_rto[target_addr - HDLC_SLAVE_ADDR]);
+                METRICS_Add(master_metrics, METRICS_TIMEOUTS, 1);
+                TRACE(TRACE_MASTER_NO_REPLY, HDLC_MASTER_ADDR, 0, 0);
+            }
             break;
 
         case MASTER_PROCESSING_STATE:
-
-            // сохраняем данные во внутренний буффер
-            HDLC_StoreRxData(&master_rx_context);
+        {
+            // информационное поле ответа читается прямо из контекста приёма
+            uint32_t length;
+            const uint8_t* payload = HDLC_RxPayload(&master_rx_context, &length);
             
-            // отладочный вывод
-            printf("Master:\tReceived infromation:\t\t");
-            for(int i=0; i<HDLC_INFO_SIZE; i++)
+            rto_typedef* rto = &master_rto[target_addr - HDLC_SLAVE_ADDR];
+
+            // ответ на повторно переданный кадр не измеряется (алгоритм Карна)
+            if(reject_count == 0)
+                FSM_MasterMeasureRtt(rto, sent_us);
+            master_state=MASTER_PREPARE_STATE;
+
+            // REJ: ведомый отбросил кадр - повтор сразу, без ожидания таймаута
+            if(master_rx_context.rx_data.supervisory && reject_count < MASTER_REJECT_LIMIT)
+            {
+                TRACE(TRACE_MASTER_REJ, HDLC_MASTER_ADDR, 0, 0);
+                resend = true;
+                reject_count++;
+                METRICS_Add(master_metrics, METRICS_RETRANSMITS, 1);
+                break;
+            }
+            if(master_rx_context.rx_data.supervisory)
             {
-                printf("%02X ", master_rx_context.rx_data.information[i]);
+                // повторы по REJ исчерпаны: ответ ждется до таймаута с удвоением RTO, как при потере кадра
+                TRACE(TRACE_MASTER_REJ_LIMIT, HDLC_MASTER_ADDR, reject_count, 0);
+                HDLC_RxContextInit(&master_rx_context);
+                FSM_MasterStartTimer(&reply_timer, &reply_expired, rto);
+                master_state=MASTER_WAITING_REPLY_STATE;
+                break;
             }
-            printf("\n");
 
+            FSM_MasterReply(master_rx_context.rx_data.control, payload, length);
+            METRICS_Add(master_metrics, METRICS_REPLIES, 1);
+            break;
+        }
+
+        default:
             master_state=MASTER_PREPARE_STATE;
             break;
+    }
+}
+
+#else
+
+master_link_typedef master_links[HDLC_SLAVE_COUNT];         // нумерация кадров для каждого ведомого
+static master_window_typedef master_window;                 // неподтвержденные кадры текущего ведомого
+
+// слот окна для кадра с номером ns
+static master_window_slot_typedef* FSM_MasterWindowSlot(master_link_typedef* link, uint8_t ns)
+{
+    return &master_window.slot[(master_window.first + HDLC_SEQ_DISTANCE(link->va, ns)) % MASTER_WINDOW_SIZE];
+}
+
+// переход к следующему адресу цикла опроса
+static void FSM_MasterNextTarget(int* poll_index)
+{
+    *poll_index = (*poll_index + 1) % MASTER_POLL_COUNT;
+    master_window.burst = 0;
+    master_window.send = (*poll_index < HDLC_SLAVE_COUNT) ? master_links[*poll_index].vs : 0;
+}
+
+// приём ответов параллельно с передачей: N(R) ответа подтверждает все кадры до N(R)-1
+static bool FSM_MasterServiceReply(master_link_typedef* link)
+{
+    bool acknowledged=false;                        // окно сдвинулось
+    rto_typedef* rto = (link != NULL) ? &master_rto[link - master_links] : NULL;
+
+    if (FifoIsEmpty(&fifo_stm))                                 return false;
+    HDLC_ReceiveByte(&master_rx_context, &fifo_stm, HDLC_MASTER_ADDR);
+    if (!master_rx_context.frame_assembled)                     return false;
+
+    if (master_rx_context.frame_correct && link != NULL)
+    {
+        hdlc_packet_typedef* reply = &master_rx_context.rx_data;
+        uint8_t acked = HDLC_SEQ_DISTANCE(link->va, reply->nr);
+
+        if (!reply->supervisory)
+        {
+            // ведомый не повторяет ответы: пропущенный ответ только отмечается
+            if (reply->ns != link->vr)
+                TRACE(TRACE_MASTER_REPLY_LOST, HDLC_MASTER_ADDR, reply->ns, link->vr);
+            link->vr = HDLC_SEQ_NEXT(reply->ns);
+
+            uint32_t length;
+            const uint8_t* payload = HDLC_RxPayload(&master_rx_context, &length);
+
+            FSM_MasterReply(reply->control, payload, length);
+            METRICS_Add(master_metrics, METRICS_REPLIES, 1);
+        }
+
+        if (acked > HDLC_SEQ_DISTANCE(link->va, link->vs))
+        {
+            TRACE(TRACE_MASTER_BAD_NR, HDLC_MASTER_ADDR, reply->nr, link->vs);
+        }
+        else if (acked > 0)
+        {
+            // RTT по последнему подтвержденному кадру, если он передавался один раз (алгоритм Карна)
+            master_window_slot_typedef* newest = FSM_MasterWindowSlot(link, (uint8_t)(reply->nr - 1));
+
+            if (!newest->retransmitted)
+                FSM_MasterMeasureRtt(rto, newest->sent_us);
+
+            // подтвержденные кадры больше не нужны окну
+            for (uint8_t i = 0; i < acked; i++)
+            {
+                FrameRelease(master_window.slot[master_window.first].frame);
+                master_window.slot[master_window.first].frame = NULL;
+                master_window.first = (master_window.first + 1) % MASTER_WINDOW_SIZE;
+            }
+            link->va = reply->nr;
+            link->reject_count = 0;
+            acknowledged = true;
+            TRACE(TRACE_MASTER_ACK, HDLC_MASTER_ADDR, reply->nr, 0);
+
+            // подтверждение могло опередить повторную передачу
+            if (HDLC_SEQ_DISTANCE(link->va, master_window.send) > HDLC_SEQ_DISTANCE(link->va, link->vs))
+                master_window.send = link->va;
+
+            if (link->va == link->vs)
+            {
+                TIMER_Cancel(&master_timers, &link->ack_timer);
+                link->ack_expired = false;
+            }
+            else
+                FSM_MasterStartTimer(&link->ack_timer, &link->ack_expired, rto);
+        }
+
+        // REJ: повтор всех кадров начиная с N(R); после MASTER_REJECT_LIMIT повторов подряд - только по таймауту подтверждения
+        if (reply->supervisory && reply->control == HDLC_S_REJ && acked <= HDLC_SEQ_DISTANCE(link->va, link->vs))
+        {
+            if (link->reject_count < MASTER_REJECT_LIMIT)
+            {
+                TRACE(TRACE_MASTER_REJ, HDLC_MASTER_ADDR, link->va, 0);
+                link->reject_count++;
+                master_window.send = link->va;
+                acknowledged = true;
+            }
+            else
+                TRACE(TRACE_MASTER_REJ_LIMIT, HDLC_MASTER_ADDR, link->reject_count, 0);
+        }
+    }
+    HDLC_RxContextInit(&master_rx_context);
+    return acknowledged;
+}
+
+// конечный автомат ведущего (окно из MASTER_WINDOW_SIZE кадров, повтор go-back-N)
+void FSM_Master(void)
+{
+    static int poll_index=0;                        // номер опрашиваемого адреса в цикле опроса
+    static uint8_t target_addr=HDLC_SLAVE_ADDR;     // адрес текущего кадра
+
+    static bool initialized=false;
+    master_link_typedef* link = (poll_index < HDLC_SLAVE_COUNT) ? &master_links[poll_index] : NULL;
+    frame_buffer_typedef* frame = NULL;             // буффер пула для нового кадра
+
+    // буффер приёма ответов берется из пула раньше кадров окна
+    if(!initialized)
+    {
+        HDLC_RxContextInit(&master_rx_context);
+        FSM_MasterAttachMetrics();
+        initialized=true;
+    }
+    TIMER_Advance(&master_timers, GetCurrentTimeUs());
+
+    switch(master_state)
+    {
+        case MASTER_PREPARE_STATE:
+
+            // таймаут подтверждения: повтор всех неподтвержденных кадров
+            if (link != NULL && link->ack_expired)
+            {
+                TRACE(TRACE_MASTER_ACK_TIMEOUT, HDLC_MASTER_ADDR, link->va, 0);
+                master_window.send = link->va;
+                RTO_Backoff(&master_rto[poll_index]);
+                METRICS_Add(master_metrics, METRICS_TIMEOUTS, 1);
+                FSM_MasterStartTimer(&link->ack_timer, &link->ack_expired, &master_rto[poll_index]);
+            }
+
+            // окно текущего ведомого исчерпано и подтверждено - переход к следующему адресу
+            if (link != NULL && master_window.send == link->vs && master_window.burst >= MASTER_WINDOW_SIZE &&
+                (MASTER_POLL_COUNT == 1 || link->va == link->vs))
+            {
+                FSM_MasterNextTarget(&poll_index);
+                link = (poll_index < HDLC_SLAVE_COUNT) ? &master_links[poll_index] : NULL;
+            }
+            target_addr = (link != NULL) ? (uint8_t)(HDLC_SLAVE_ADDR + poll_index) : HDLC_BROADCAST_ADDR;
+
+            if (link == NULL)
+            {
+                // широковещательный кадр не нумеруется ведомыми и не подтверждается
+                TRACE(TRACE_MASTER_PREPARE, HDLC_MASTER_ADDR, USER_COMMAND, target_addr);
+                HDLC_TxContextInit(&master_tx_context, target_addr, USER_COMMAND);
+            }
+            else if (master_window.send != link->vs)
+            {
+                // повторная передача кадра из окна
+                master_window_slot_typedef* slot = FSM_MasterWindowSlot(link, master_window.send);
+
+                TRACE(TRACE_MASTER_RESEND, HDLC_MASTER_ADDR, master_window.send, target_addr);
+                hdlc_header_typedef header = {.address=target_addr, .control=slot->command, .ns=master_window.send, .nr=link->vr};
+
+                // кадр передаётся прямо из буффера окна
+                slot->retransmitted = true;
+                METRICS_Add(master_metrics, METRICS_RETRANSMITS, 1);
+                HDLC_TxContextInitFrame(&master_tx_context, &header, slot->frame);
+                master_window.send = HDLC_SEQ_NEXT(master_window.send);
+            }
+            else if (master_window.burst < MASTER_WINDOW_SIZE && HDLC_SEQ_DISTANCE(link->va, link->vs) < MASTER_WINDOW_SIZE &&
+                     (frame = FrameAlloc()) != NULL)
+            {
+                // новый кадр: буффер пула удерживается окном до подтверждения
+                master_window_slot_typedef* slot = FSM_MasterWindowSlot(link, link->vs);
+
+                TRACE(TRACE_MASTER_PREPARE_SEQUENCED, HDLC_MASTER_ADDR, target_addr, link->vs);
+                hdlc_header_typedef header = {.address=target_addr, .control=USER_COMMAND, .ns=link->vs, .nr=link->vr};
+
+                // данные пользователя помещаются в буффер один раз и передаются из него без копирования
+                frame->length = master_tx_context.internal_tx_length;
+                memcpy(frame->data, master_tx_context.internal_tx_buffer, frame->length);
+                slot->command = USER_COMMAND;
+                slot->frame = frame;
+                slot->retransmitted = false;
+                HDLC_TxContextInitFrame(&master_tx_context, &header, slot->frame);
+                link->vs = HDLC_SEQ_NEXT(link->vs);
+                master_window.send = link->vs;
+                master_window.burst++;
+            }
+            else
+            {
+                // окно заполнено (или нет свободных буфферов пула) - ждем подтверждений
+                TRACE(TRACE_MASTER_WAIT_ACK, HDLC_MASTER_ADDR, target_addr, HDLC_SEQ_DISTANCE(link->va, link->vs));
+                master_state=MASTER_WAITING_REPLY_STATE;
+                break;
+            }
+
+            TRACE(TRACE_TX_START, HDLC_MASTER_ADDR, 0, 0);
+            master_state=MASTER_TX_STATE;
+            break;
+
+        case MASTER_TX_STATE:
+
+            // передача кадра и одновременный приём подтверждений
+            if(!FifoIsFull(&fifo_mts))
+                HDLC_SendByte(&master_tx_context, &fifo_mts);
+            else
+                METRICS_Add(master_metrics, METRICS_FIFO_FULL, 1);
+            FSM_MasterServiceReply(link);
+
+            if(master_tx_context.tx_stage==TX_STAGE_COMPLETED)
+            {
+                TRACE(TRACE_TX_DONE, HDLC_MASTER_ADDR, 0, 0);
+
+                if (link == NULL)
+                    FSM_MasterNextTarget(&poll_index);
+                else
+                {
+                    // кадр еще в окне, если подтверждение не опередило окончание передачи
+                    uint8_t ns = master_tx_context.tx_data.ns;
+
+                    if (HDLC_SEQ_DISTANCE(link->va, ns) < HDLC_SEQ_DISTANCE(link->va, link->vs))
+                        FSM_MasterWindowSlot(link, ns)->sent_us = GetCurrentTimeUs();
+                    if (!TIMER_IsActive(&link->ack_timer))
+                        FSM_MasterStartTimer(&link->ack_timer, &link->ack_expired, &master_rto[poll_index]);
+                }
+                master_state=MASTER_PREPARE_STATE;
+            }
+            break;
+
+        case MASTER_WAITING_REPLY_STATE:
+
+            // ожидание подтверждений: окно сдвинулось или истек таймаут
+            if (FSM_MasterServiceReply(link) || link == NULL || link->ack_expired)
+            {
+                master_state=MASTER_PREPARE_STATE;
+            }
+            break;
 
         default:
             master_state=MASTER_PREPARE_STATE;
             break;
     }
 }
+#endif
 
-// конечный автомат ведомого
-void FSM_Slave(void)
+// копирование новых байт шины (fifo_mts) в FIFO каждого ведомого: все узлы видят одну и ту же линию
+static void FSM_BusDistribute(void)
+{
+    fifo_span_typedef span;
+    uint32_t length = UINT32_MAX;
+
+    for(int i = 0; i < HDLC_SLAVE_COUNT; i++)
+    {
+        uint32_t free_space = FifoFreeSpace(&slave_nodes[i].rx_fifo);
+        if(free_space < length)
+            length = free_space;
+    }
+
+    length = FifoReadPeek(&fifo_mts, length, &span);
+    for(int i = 0; i < HDLC_SLAVE_COUNT; i++)
+    {
+        FifoWrite(&slave_nodes[i].rx_fifo, span.region[0].data, span.region[0].length);
+        FifoWrite(&slave_nodes[i].rx_fifo, span.region[1].data, span.region[1].length);
+    }
+    FifoReadConsume(&fifo_mts, length);
+}
+
+// отправка REJ ведущему: кадр с N(S)=V(R) не принят и должен быть повторен
+// при нумерации на один разрыв последовательности отправляется один REJ (false - REJ уже отправлен)
+static bool FSM_SlaveReject(slave_node_typedef* node)
 {
-    static bool processing_complete=false;      // флаг завершения обработки принятого сообщения
-    static bool reply_sent=false;               // флаг отправленного ответа
+#if HDLC_SEQ_MODULO
+    if(node->reject_sent)
+        return false;
+    node->reject_sent = true;
+#endif
+    HDLC_TxContextInitSupervisory(&node->tx_context, HDLC_MASTER_ADDR, HDLC_S_REJ, node->vr);
+    node->processing_complete = true;
+    node->reply_sent = true;
+    node->state = SLAVE_TX_STATE;
+    return true;
+}
+
+// ошибка принятого кадра, о которой ведомый сразу сообщает REJ (FCS, длина)
+// неизвестная команда не входит: повтор кадра ее не исправит, ведомый отвечает CMD_ERROR
+static bool FSM_SlaveRejectable(const hdlc_rx_context_typedef* rx_context, uint8_t address)
+{
+    switch(rx_context->rx_error)
+    {
+        case HDLC_RX_BAD_FCS:
+        case HDLC_RX_WRONG_SIZE:
+        case HDLC_RX_TOO_LONG:
+            // на широковещательный кадр ведомые не отвечают
+            return rx_context->rx_error_address == address;
+        default:
+            return false;
+    }
+}
 
-    switch(slave_state)
+// конечный автомат одного ведомого узла
+static void FSM_SlaveNode(slave_node_typedef* node)
+{
+    switch(node->state)
     {
         case SLAVE_WAITING_CMD_STATE:
 
             // ожидаем флаг начала передачи от ведущего
-            if (!FifoIsEmpty(&fifo_mts))
-                HDLC_ReceiveByte(&slave_rx_context, &fifo_mts, HDLC_SLAVE_ADDR, "Slave");
+            if (!FifoIsEmpty(&node->rx_fifo))
+                HDLC_ReceiveByte(&node->rx_context, &node->rx_fifo, node->address);
             else
-                printf("Slave:\tFIFO is empty, waiting...\n");
+            {
+                TRACE(TRACE_FIFO_EMPTY, node->address, 0, 0);
+                METRICS_Add(node->metrics, METRICS_FIFO_EMPTY, 1);
+            }
 
-            if(slave_rx_context.fd_received && !slave_rx_context.frame_assembled)
+            if(node->rx_context.fd_received && !node->rx_context.frame_assembled)
             {
-                slave_state=SLAVE_RX_STATE;
+                node->rx_context.rx_error = HDLC_RX_OK;
+                node->state=SLAVE_RX_STATE;
             }
             break;
 
         case SLAVE_RX_STATE:
 
             // приём сообщения от ведущего
-            if (!FifoIsEmpty(&fifo_mts))
-                HDLC_ReceiveByte(&slave_rx_context, &fifo_mts, HDLC_SLAVE_ADDR, "Slave");
+            if (!FifoIsEmpty(&node->rx_fifo))
+                HDLC_ReceiveByte(&node->rx_context, &node->rx_fifo, node->address);
             else
-                printf("Slave:\tFIFO is empty, waiting...\n");
+            {
+                TRACE(TRACE_FIFO_EMPTY, node->address, 0, 0);
+                METRICS_Add(node->metrics, METRICS_FIFO_EMPTY, 1);
+            }
 
-            if(slave_rx_context.frame_assembled && slave_rx_context.frame_correct)
+            if(node->rx_context.frame_assembled && node->rx_context.frame_correct && node->rx_context.rx_data.supervisory)
+            {
+                // S-кадры ведомым не адресуются
+                HDLC_RxContextInit(&node->rx_context);
+                node->state = SLAVE_WAITING_CMD_STATE;
+            }
+            else if(node->rx_context.frame_assembled && node->rx_context.frame_correct)
+            {
+                node->state = SLAVE_PROCESSING_STATE;
+            }
+            else if(node->rx_context.frame_assembled && node->rx_context.rx_error == HDLC_RX_UNKNOWN_COMMAND)
+            {
+                // кадр без искажений с незарегистрированной командой: выполняется как обычный, ответ - CMD_ERROR
+                node->state = SLAVE_PROCESSING_STATE;
+            }
+            else if(FSM_SlaveRejectable(&node->rx_context, node->address))
+            {
+                // кадр отброшен при проверке: ведущий повторит его по REJ, не дожидаясь таймаута
+                TRACE(TRACE_SLAVE_REJECT, node->address, node->rx_context.rx_error, node->vr);
+                node->rx_context.rx_error = HDLC_RX_OK;
+                if(!FSM_SlaveReject(node))
+                    node->state = SLAVE_WAITING_CMD_STATE;
+            }
+            else if(!node->rx_context.fd_received)
             {
-                printf("Slave:\tFrame received completely!\n");
-                slave_state = SLAVE_PROCESSING_STATE;
+                // кадр другому узлу пропущен или приём сброшен - ждем следующий
+                node->state = SLAVE_WAITING_CMD_STATE;
             }
-            else if(slave_rx_context.frame_assembled && !slave_rx_context.frame_correct)
+            else if(node->rx_context.frame_assembled && !node->rx_context.frame_correct)
             {
-                printf("Slave:\tFrame is incorrect!");
-                HDLC_RxContextInit(&slave_rx_context);
-                slave_state = SLAVE_WAITING_CMD_STATE;
+                TRACE(TRACE_RX_FRAME_FAILED, node->address, 0, 0);
+                HDLC_RxContextInit(&node->rx_context);
+                node->state = SLAVE_WAITING_CMD_STATE;
             }
             break;
 
         case SLAVE_PROCESSING_STATE:
+        {
+#if HDLC_SEQ_MODULO
+            // кадр вне последовательности не выполняется: ведущий повторит кадры начиная с V(R)
+            if(node->rx_context.rx_data.address != HDLC_BROADCAST_ADDR && node->rx_context.rx_data.ns != node->vr)
+            {
+                TRACE(TRACE_SLAVE_OUT_OF_SEQUENCE, node->address, node->rx_context.rx_data.ns, node->vr);
+                HDLC_RxContextInit(&node->rx_context);
+
+                if(!FSM_SlaveReject(node))
+                    node->state = SLAVE_WAITING_CMD_STATE;
+                break;
+            }
+#endif
 
-            // сохранение и обработка принятого сообщения
-            HDLC_StoreRxData(&slave_rx_context);
+            // обработка принятого сообщения прямо из контекста приёма
+            uint32_t length;
+            const uint8_t* payload = HDLC_RxPayload(&node->rx_context, &length);
 
             // отладочная информация
-            printf("Slave:\tReceived information:\t\t");
-            for(int i=0; i<HDLC_INFO_SIZE; i++)
+            TRACE(TRACE_RX_PAYLOAD, node->address, length, TRACE_PayloadHead(payload, length));
+
+            node->command_for_reply = ProcessCommand(&node->rx_context, &node->tx_context);
+
+            // на широковещательный кадр ведомые не отвечают
+            if(node->rx_context.rx_data.address == HDLC_BROADCAST_ADDR)
             {
-                printf("%02X ", slave_rx_context.rx_data.information[i]);
+                TRACE(TRACE_SLAVE_BROADCAST, node->address, 0, 0);
+                HDLC_RxContextInit(&node->rx_context);
+                node->state = SLAVE_WAITING_CMD_STATE;
+                break;
             }
-            printf("\n");
-
-            uint8_t command_for_reply = slave_rx_context.rx_data.control;       // переменная для хранения команды
-            ProcessCommand(&slave_rx_context, &slave_tx_context);
     
-            processing_complete = true;
-            reply_sent = false;
-            HDLC_RxContextInit(&slave_rx_context);
-            slave_state = SLAVE_TX_STATE;
+            node->processing_complete = true;
+            node->reply_sent = false;
+#if HDLC_SEQ_MODULO
+            // ответ несет N(R) - подтверждение всех кадров до принятого включительно
+            node->vr = HDLC_SEQ_NEXT(node->vr);
+            node->reject_sent = false;
+            HDLC_TxContextInitSequenced(&node->tx_context, HDLC_MASTER_ADDR, node->command_for_reply, node->vs, node->vr);
+            node->vs = HDLC_SEQ_NEXT(node->vs);
+            node->reply_sent = true;
+#endif
+            HDLC_RxContextInit(&node->rx_context);
+            node->state = SLAVE_TX_STATE;
             break;
+        }
 
         case SLAVE_TX_STATE:
 
-            // При получении нового сообщения - прерываем отправку
-            if (!FifoIsEmpty(&fifo_mts)) 
+#if HDLC_SEQ_MODULO == 0
+            // При получении нового сообщения этому узлу - прерываем отправку
+            if (!FifoIsEmpty(&node->rx_fifo)) 
             {
-                HDLC_ReceiveByte(&slave_rx_context, &fifo_mts, HDLC_SLAVE_ADDR, "Slave");
+                HDLC_ReceiveByte(&node->rx_context, &node->rx_fifo, node->address);
         
-                if (slave_rx_context.fd_received && !slave_rx_context.frame_assembled) 
+                if (node->rx_context.fd_received && node->rx_context.buf_index > 0 &&
+                    !node->rx_context.skip_frame && !node->rx_context.frame_assembled) 
                 {
                     FifoIndexReset(&fifo_stm);
-                    slave_state = SLAVE_RX_STATE;
-                    processing_complete = false;
-                    reply_sent = false;
+                    node->state = SLAVE_RX_STATE;
+                    node->processing_complete = false;
+                    node->reply_sent = false;
                     return;
                 }
             }
+#endif
 
             // отправка ответа ведущему
-            if(processing_complete && !reply_sent)
+            if(node->processing_complete && !node->reply_sent)
             {
-                HDLC_TxContextInit(&slave_tx_context, HDLC_MASTER_ADDR, command_for_reply);
-                printf("Slave:\tPreparing reply to master...\n");
-                reply_sent=true;
+                HDLC_TxContextInit(&node->tx_context, HDLC_MASTER_ADDR, node->command_for_reply);
+                TRACE(TRACE_SLAVE_REPLY, node->address, 0, 0);
+                node->reply_sent=true;
             }
 
             if(!FifoIsFull(&fifo_stm))
             {
-                HDLC_SendByte(&slave_tx_context, &fifo_stm);
+                HDLC_SendByte(&node->tx_context, &fifo_stm);
 
-                if(slave_tx_context.tx_stage==TX_STAGE_COMPLETED)
+                if(node->tx_context.tx_stage==TX_STAGE_COMPLETED)
                 {
-                    printf("Slave:\tReply sent completely!\n");
+                    TRACE(TRACE_TX_DONE, node->address, 0, 0);
 
-                    HDLC_RxContextInit(&slave_rx_context);
-                    processing_complete=false;
-                    reply_sent=false;
+                    HDLC_RxContextInit(&node->rx_context);
+                    node->processing_complete=false;
+                    node->reply_sent=false;
 
-                    slave_state=SLAVE_WAITING_CMD_STATE;
+                    node->state=SLAVE_WAITING_CMD_STATE;
 
                     // отладочная информация
-                    printf("Slave:\tTransmitted information:\t");
-                    for(int i=0; i<HDLC_INFO_SIZE; i++)
-                    {
-                        printf("%02X ", slave_tx_context.tx_data.information[i]);
-                    }
-                    printf("\n");
-                    printf("Slave:\tWaiting for next message...\n");
+                    TRACE(TRACE_TX_PAYLOAD, node->address, node->tx_context.tx_data.info_length,
+                          TRACE_PayloadHead(node->tx_context.tx_data.information, node->tx_context.tx_data.info_length));
+                    TRACE(TRACE_SLAVE_WAIT, node->address, 0, 0);
                 }
             }
             else
             {
-                printf("Slave:\tFIFO is full, waiting...\n");
+                TRACE(TRACE_FIFO_FULL, node->address, 0, 0);
+                METRICS_Add(node->metrics, METRICS_FIFO_FULL, 1);
             }
             break;
 
         default:
-            HDLC_RxContextInit(&slave_rx_context);
-            slave_state=SLAVE_WAITING_CMD_STATE;
+            HDLC_RxContextInit(&node->rx_context);
+            node->state=SLAVE_WAITING_CMD_STATE;
             break;
     }
-}
\ No newline at end of file
+}
+
+// конечный автомат ведомых: шина и все узлы
+void FSM_Slave(void)
+{
+    static bool initialized=false;
+
+    if(!initialized)
+    {
+        for(int i = 0; i < HDLC_SLAVE_COUNT; i++)
+        {
+            slave_node_typedef* node = &slave_nodes[i];
+
+            node->address = (uint8_t)(HDLC_SLAVE_ADDR + i);
+            node->state = SLAVE_WAITING_CMD_STATE;
+            node->metrics = METRICS_Link(node->address);
+            node->rx_context.metrics = node->metrics;
+            node->tx_context.metrics = node->metrics;
+            FifoInit(&node->rx_fifo);
+            HDLC_RxContextInit(&node->rx_context);
+        }
+        initialized=true;
+    }
+
+    FSM_BusDistribute();
+    for(int i = 0; i < HDLC_SLAVE_COUNT; i++)
+    {
+        FSM_SlaveNode(&slave_nodes[i]);
+    }
+}
@@ -4,6 +4,9 @@
 #include "hdlc.h"
 #include "fifo.h"
 #include "timer.h"
+#include "timer_wheel.h"
+#include "rto.h"
+#include "metrics.h"
 
 
 typedef enum                        // перечисление состояний ведущего устройства
@@ -23,18 +26,78 @@ typedef enum                        // перечисление состояни
     SLAVE_TX_STATE                  // состояние отправки ответа в FIFO
 } fsm_state_slave_typedef;
 
+#ifdef MASTER_POLL_BROADCAST
+#define MASTER_POLL_COUNT       (HDLC_SLAVE_COUNT + 1)  // в цикл опроса входит широковещательный кадр
+#else
+#define MASTER_POLL_COUNT       HDLC_SLAVE_COUNT        // в цикл опроса входят только ведомые
+#endif
+
+typedef struct                                  // ведомый узел на шине
+{
+    uint8_t address;                            // адрес узла
+    fsm_state_slave_typedef state;              // состояние узла в конечном автомате
+    fifo_typedef rx_fifo;                       // данные шины, принимаемые этим узлом
+    hdlc_rx_context_typedef rx_context;         // приём кадров от ведущего
+    hdlc_tx_context_typedef tx_context;         // отправка ответов ведущему
+    bool processing_complete;                   // флаг завершения обработки принятого сообщения
+    bool reply_sent;                            // флаг подготовленного ответа
+    uint8_t command_for_reply;                  // команда, на которую отправляется ответ
+    uint8_t vs;                                 // V(S) - номер следующего ответа (при HDLC_SEQ_MODULO != 0)
+    uint8_t vr;                                 // V(R) - номер следующего ожидаемого кадра ведущего
+    bool reject_sent;                           // REJ на текущий разрыв последовательности уже отправлен
+    metrics_link_typedef* metrics;              // метрики узла
+} slave_node_typedef;
+
+#if HDLC_SEQ_MODULO
+#if MASTER_WINDOW_SIZE < 1 || MASTER_WINDOW_SIZE >= HDLC_SEQ_MODULO
+#error "MASTER_WINDOW_SIZE должен быть от 1 до HDLC_SEQ_MODULO-1"
+#endif
+
+typedef struct                                  // состояние нумерации ведущего для одного ведомого
+{
+    uint8_t vs;                                 // V(S) - номер следующего нового кадра
+    uint8_t va;                                 // V(A) - номер самого старого неподтвержденного кадра
+    uint8_t vr;                                 // V(R) - номер следующего ожидаемого ответа
+    timer_typedef ack_timer;                    // таймер подтверждения неподтвержденных кадров
+    bool ack_expired;                           // таймер подтверждения истек - нужен повтор с V(A)
+    uint32_t reject_count;                      // повторов с V(A) по REJ подряд (сбрасывается подтверждением)
+} master_link_typedef;
+
+typedef struct                                  // неподтвержденный кадр в окне ведущего
+{
+    uint8_t command;                            // команда кадра
+    frame_buffer_typedef* frame;                // информационное поле для повторной передачи (буффер пула)
+    uint64_t sent_us;                           // время окончания последней передачи кадра
+    bool retransmitted;                         // кадр передавался повторно: RTT по нему не измеряется
+} master_window_slot_typedef;
+
+typedef struct                                  // окно передачи ведущего (go-back-N)
+{
+    master_window_slot_typedef slot[MASTER_WINDOW_SIZE];    // кадры с номерами V(A)..V(S)-1
+    uint32_t first;                             // слот кадра с номером V(A)
+    uint8_t send;                               // номер следующего передаваемого кадра (от V(A) до V(S))
+    uint32_t burst;                             // новых кадров текущему ведомому в этом цикле опроса
+} master_window_typedef;
+
+extern master_link_typedef master_links[HDLC_SLAVE_COUNT];   // нумерация кадров для каждого ведомого
+#endif
+
 extern fsm_state_master_typedef master_state;   // состояние ведущего в конечном автомате
-extern fsm_state_slave_typedef slave_state;     // состояние ведомого в конечном автомате
+extern slave_node_typedef slave_nodes[HDLC_SLAVE_COUNT];    // ведомые узлы на шине
 
-extern fifo_typedef fifo_mts;                   // FIFO Master To Slave
+extern fifo_typedef fifo_mts;                   // FIFO Master To Slave (общая шина всех ведомых)
 extern fifo_typedef fifo_stm;                   // FIFO Slave To Master
 
-extern timeout_typedef master_timeout;                // таймаут для получения ответа
+extern timer_wheel_typedef master_timers;       // таймеры ведущего (продвигаются в начале каждого шага FSM_Master)
+extern rto_typedef master_rto[HDLC_SLAVE_COUNT];    // RTT и таймаут ответа каждого ведомого
+
+// функция подготовки информационного поля ведущего (при USER_COMMAND CMD_AGGREGATE - пакет подкоманд из USER_INFO_PACK)
+void FSM_MasterPreparePayload(void);
 
 // конечный автомат ведущего
 void FSM_Master(void);
 
-// конечный автомат ведомого
+// конечный автомат ведомых (распределение данных шины и автоматы всех узлов)
 void FSM_Slave(void);
 
 #endif
\ No newline at end of file
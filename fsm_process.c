@@ -0,0 +1,239 @@
+#include "fsm_process.h"
+
+#ifdef PROCESS_MODE
+
+#if !defined(LINUX)
+#error "PROCESS_MODE требует LINUX"
+#endif
+
+#if defined(THREADED_MODE)
+#error "PROCESS_MODE и THREADED_MODE не могут быть включены одновременно"
+#endif
+
+#include "transport.h"
+#include "trace.h"
+#include "metrics.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
+
+#define PROCESS_STEP_BUDGET     4096        // шагов автомата подряд, после которых линия обслуживается принудительно
+#define PROCESS_MAX_EVENTS      4           // событий epoll за один вызов
+
+static volatile sig_atomic_t process_stop = 0;  // получен SIGINT или SIGTERM - завершение с выводом итогов
+
+static void ProcessSignal(int signal_number)
+{
+    (void)signal_number;
+    process_stop = 1;
+}
+
+// шаг автомата процесса; true - автомат продвинулся (состояние или FIFO изменились)
+typedef bool (*process_step_typedef)(void);
+
+static bool MasterStep(void)
+{
+    fsm_state_master_typedef state = master_state;
+    uint32_t written = FifoWriteCounter(&fifo_mts);
+    uint32_t read = FifoReadCounter(&fifo_stm);
+
+    FSM_Master();
+
+    return state != master_state || written != FifoWriteCounter(&fifo_mts) || read != FifoReadCounter(&fifo_stm);
+}
+
+static bool SlaveStep(void)
+{
+    bool progress = false;
+    fsm_state_slave_typedef states[HDLC_SLAVE_COUNT];
+    uint32_t node_read[HDLC_SLAVE_COUNT];
+    uint32_t written = FifoWriteCounter(&fifo_stm);
+    uint32_t read = FifoReadCounter(&fifo_mts);
+
+    for(int i = 0; i < HDLC_SLAVE_COUNT; i++)
+    {
+        states[i] = slave_nodes[i].state;
+        node_read[i] = FifoReadCounter(&slave_nodes[i].rx_fifo);
+    }
+
+    FSM_Slave();
+
+    // узел сменил состояние или принял байт из своей копии шины
+    for(int i = 0; i < HDLC_SLAVE_COUNT; i++)
+    {
+        progress |= (states[i] != slave_nodes[i].state);
+        progress |= (node_read[i] != FifoReadCounter(&slave_nodes[i].rx_fifo));
+    }
+    return progress || written != FifoWriteCounter(&fifo_stm) || read != FifoReadCounter(&fifo_mts);
+}
+
+// время до ближайшего события колеса таймеров ведущего в мкс (TIMER_NEVER - без ограничения)
+static uint64_t ProcessWaitUs(bool timers)
+{
+    uint64_t deadline = timers ? TIMER_NextDeadline(&master_timers) : TIMER_NEVER;
+    uint64_t now = GetCurrentTimeUs();
+
+    if(deadline == TIMER_NEVER)
+        return TIMER_NEVER;
+    return (deadline > now) ? deadline - now : 0;
+}
+
+// ожидание готовности линии (epoll) или действия другой стороны (futex в общей памяти) не дольше wait_us
+static bool ProcessWait(transport_typedef* transport, int epoll_fd, uint32_t sequence, uint64_t wait_us)
+{
+    struct epoll_event events[PROCESS_MAX_EVENTS];
+    int count;
+
+    if(wait_us == 0)
+        return true;
+    if(transport->kind == TRANSPORT_SHM)
+    {
+        // 0 у futex - без ограничения, поэтому конечное время не меньше 1 мкс
+        TRANSPORT_WaitShared(transport, sequence, (wait_us == TIMER_NEVER) ? 0 : (wait_us >= UINT32_MAX) ? UINT32_MAX : (uint32_t)wait_us);
+        return true;
+    }
+
+    count = epoll_wait(epoll_fd, events, PROCESS_MAX_EVENTS,
+                       (wait_us == TIMER_NEVER) ? -1 : (wait_us >= (uint64_t)INT32_MAX * 1000u) ? INT32_MAX : (int)((wait_us + 999) / 1000));
+    if(count < 0 && errno != EINTR)
+    {
+        perror("epoll_wait");
+        return false;
+    }
+    for(int i = 0; i < count; i++)
+        TRANSPORT_HandleEvents(transport, events[i].data.fd, events[i].events);
+    return true;
+}
+
+// подписка на готовность дескриптора (edge-triggered: уведомление только при изменении готовности)
+static bool ProcessWatch(int epoll_fd, int fd, uint32_t events)
+{
+    struct epoll_event event = {.events = events | EPOLLET, .data.fd = fd};
+
+    return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+
+// цикл процесса: шаги автомата, перенос байт FIFO в линию и из нее, ожидание готовности линии или таймера
+static int ProcessLoop(transport_typedef* transport, process_step_typedef step, bool timers)
+{
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    bool watching;
+
+    // у линии в общей памяти нет дескрипторов: сторона засыпает на futex
+    if(transport->kind == TRANSPORT_SHM)
+        watching = true;
+    else if(transport->rx_fd == transport->tx_fd)
+        watching = ProcessWatch(epoll_fd, transport->rx_fd, EPOLLIN | EPOLLOUT);
+    else
+        watching = ProcessWatch(epoll_fd, transport->rx_fd, EPOLLIN) && ProcessWatch(epoll_fd, transport->tx_fd, EPOLLOUT);
+    if(epoll_fd < 0 || !watching)
+    {
+        perror("epoll");
+        return 1;
+    }
+
+    while(1)
+    {
+        uint32_t sequence = TRANSPORT_PrepareWait(transport);
+        bool progress = false;
+        int32_t received = 0;
+        int32_t sent = 0;
+
+        if(transport->readable)
+            received = TRANSPORT_Receive(transport);
+
+        // автомат работает, пока продвигается; заполненный FIFO передачи выгружается в линию по ходу
+        for(int i = 0; i < PROCESS_STEP_BUDGET && step(); i++)
+        {
+            progress = true;
+            if(transport->writable && FifoIsFull(transport->tx_fifo) && TRANSPORT_Send(transport) == TRANSPORT_CLOSED)
+                sent = TRANSPORT_CLOSED;
+        }
+
+        if(transport->writable && sent != TRANSPORT_CLOSED)
+            sent = TRANSPORT_Send(transport);
+
+        if(TRACE_Drain(stdout) > 0)
+            fflush(stdout);
+
+        // метрики общие для обоих процессов, снимки выгружает процесс ведущего
+        if(timers)
+            METRICS_Poll();
+
+        if(received == TRANSPORT_CLOSED || sent == TRANSPORT_CLOSED || process_stop)
+            break;
+
+        // есть работа без ожидания: автомат продвинулся или в линии могут остаться данные
+        if(progress || received > 0 || sent > 0)
+            continue;
+
+        if(!ProcessWait(transport, epoll_fd, sequence, ProcessWaitUs(timers)))
+            break;
+    }
+
+    close(epoll_fd);
+    return 0;
+}
+
+// итог работы конца линии
+static void ProcessReport(const char* name, transport_typedef* transport)
+{
+    printf("%s transport (%s): received %llu bytes in %llu reads, sent %llu bytes in %llu writes\n",
+           name, TRANSPORT_KindName(transport->kind),
+           (unsigned long long)transport->rx_bytes, (unsigned long long)transport->rx_calls,
+           (unsigned long long)transport->tx_bytes, (unsigned long long)transport->tx_calls);
+    fflush(stdout);
+}
+
+// запуск ведущего и ведомого в отдельных процессах, соединенных линией PROCESS_TRANSPORT (PROCESS_MODE)
+int FSM_RunProcesses(void)
+{
+    transport_typedef master_end;
+    transport_typedef slave_end;
+    int result;
+    pid_t slave_pid;
+    struct sigaction stop = {.sa_handler = ProcessSignal};     // без SA_RESTART: epoll_wait прерывается сигналом
+
+    signal(SIGPIPE, SIG_IGN);                       // закрытие линии обрабатывается по EPIPE
+    sigaction(SIGINT, &stop, NULL);
+    sigaction(SIGTERM, &stop, NULL);
+    if(!TRANSPORT_OpenPair(PROCESS_TRANSPORT, &master_end, &slave_end))
+    {
+        perror("transport");
+        return 1;
+    }
+
+    fflush(stdout);
+    slave_pid = fork();
+    if(slave_pid < 0)
+    {
+        perror("fork");
+        return 1;
+    }
+
+    if(slave_pid == 0)
+    {
+        // процесс ведомых: приём в fifo_mts, ответы из fifo_stm
+        TRANSPORT_Close(&master_end);
+        TRANSPORT_Attach(&slave_end, &fifo_mts, &fifo_stm);
+        result = ProcessLoop(&slave_end, SlaveStep, false);
+        ProcessReport("Slave", &slave_end);
+        TRANSPORT_Close(&slave_end);
+        _exit(result);
+    }
+
+    // процесс ведущего: кадры из fifo_mts, приём ответов в fifo_stm
+    TRANSPORT_Close(&slave_end);
+    TRANSPORT_Attach(&master_end, &fifo_stm, &fifo_mts);
+    result = ProcessLoop(&master_end, MasterStep, true);
+    METRICS_Publish();                              // итоговый снимок
+    ProcessReport("Master", &master_end);
+    TRANSPORT_Close(&master_end);
+    waitpid(slave_pid, NULL, 0);
+    return result;
+}
+
+#endif
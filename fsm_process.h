@@ -0,0 +1,11 @@
+#ifndef FSM_PROCESS_H
+#define FSM_PROCESS_H
+
+#include "fsm.h"
+
+// запуск ведущего и ведомого в отдельных процессах, соединенных линией PROCESS_TRANSPORT (PROCESS_MODE)
+// каждый процесс выполняет шаги своего автомата и переносит байты FIFO в линию и из нее, ожидая готовности в epoll
+// возвращает код завершения после закрытия линии (0 - линия закрыта другой стороной)
+int FSM_RunProcesses(void);
+
+#endif
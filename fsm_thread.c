@@ -0,0 +1,158 @@
+#include "fsm_thread.h"
+
+#ifdef THREADED_MODE
+
+#if !defined(LINUX) || !defined(FIFO_SPSC)
+#error "THREADED_MODE требует LINUX и FIFO_SPSC"
+#endif
+
+#include "event.h"
+#include "trace.h"
+#include "metrics.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#define TRACE_DRAIN_PERIOD_MS   10      // период вывода журнала событий
+
+static event_typedef master_event;      // пробуждение ведущего (данные в fifo_stm или место в fifo_mts)
+static event_typedef slave_event;       // пробуждение ведомого (данные в fifo_mts или место в fifo_stm)
+static atomic_bool threads_stop;        // запрос завершения потоков (проверяется после EventPrepare: EventSignal не теряется)
+
+// поток ведущего: пишет в fifo_mts, читает из fifo_stm
+static void* MasterThread(void* arg)
+{
+    (void)arg;
+    while(1)
+    {
+        uint32_t sequence = EventPrepare(&master_event);
+        if(atomic_load(&threads_stop))
+            break;
+
+        fsm_state_master_typedef state = master_state;
+        uint32_t written = FifoWriteCounter(&fifo_mts);
+        uint32_t read = FifoReadCounter(&fifo_stm);
+
+        FSM_Master();
+
+        bool data_sent = (FifoWriteCounter(&fifo_mts) != written);
+        bool space_freed = (FifoReadCounter(&fifo_stm) != read);
+
+        if(data_sent || space_freed)
+            EventSignal(&slave_event);
+
+        // шаг ничего не изменил - ждем ведомого или ближайшего события колеса таймеров
+        if(!data_sent && !space_freed && state == master_state)
+        {
+            uint64_t deadline = TIMER_NextDeadline(&master_timers);
+            uint64_t now = GetCurrentTimeUs();
+
+            // наступившее событие автомат обработает на следующем шаге
+            if(deadline == TIMER_NEVER)
+                EventWait(&master_event, sequence, 0);
+            else if(deadline > now)
+                EventWait(&master_event, sequence, (deadline - now > UINT32_MAX) ? UINT32_MAX : (uint32_t)(deadline - now));
+        }
+    }
+    return NULL;
+}
+
+// поток ведомого: читает из fifo_mts, пишет в fifo_stm
+static void* SlaveThread(void* arg)
+{
+    (void)arg;
+    while(1)
+    {
+        uint32_t sequence = EventPrepare(&slave_event);
+        if(atomic_load(&threads_stop))
+            break;
+
+        bool node_progress = false;
+        fsm_state_slave_typedef states[HDLC_SLAVE_COUNT];
+        uint32_t node_read[HDLC_SLAVE_COUNT];
+
+        for(int i = 0; i < HDLC_SLAVE_COUNT; i++)
+        {
+            states[i] = slave_nodes[i].state;
+            node_read[i] = FifoReadCounter(&slave_nodes[i].rx_fifo);
+        }
+        uint32_t written = FifoWriteCounter(&fifo_stm);
+        uint32_t read = FifoReadCounter(&fifo_mts);
+
+        FSM_Slave();
+
+        bool data_sent = (FifoWriteCounter(&fifo_stm) != written);
+        bool space_freed = (FifoReadCounter(&fifo_mts) != read);
+
+        if(data_sent || space_freed)
+            EventSignal(&master_event);
+
+        // узел сменил состояние или принял байт из своей копии шины
+        for(int i = 0; i < HDLC_SLAVE_COUNT; i++)
+        {
+            node_progress |= (states[i] != slave_nodes[i].state);
+            node_progress |= (node_read[i] != FifoReadCounter(&slave_nodes[i].rx_fifo));
+        }
+
+        if(!data_sent && !space_freed && !node_progress)
+            EventWait(&slave_event, sequence, 0);
+    }
+    return NULL;
+}
+
+// поток вывода журнала и снимков метрик: форматирование событий вне потоков автоматов
+static void* TraceThread(void* arg)
+{
+    struct timespec period = {0, TRACE_DRAIN_PERIOD_MS * 1000000L};
+
+    (void)arg;
+    while(!atomic_load(&threads_stop))
+    {
+        if(TRACE_Drain(stdout) > 0)
+            fflush(stdout);
+        METRICS_Poll();
+        nanosleep(&period, NULL);
+    }
+    TRACE_Drain(stdout);                // события, записанные до остановки автоматов
+    fflush(stdout);
+    return NULL;
+}
+
+// остановка и ожидание запущенных потоков
+static void FSM_StopThreads(pthread_t* threads, int count)
+{
+    atomic_store(&threads_stop, true);
+    EventSignal(&master_event);
+    EventSignal(&slave_event);
+    for(int i = 0; i < count; i++)
+        pthread_join(threads[i], NULL);
+}
+
+// запуск конечных автоматов в отдельных потоках
+int FSM_RunThreaded(void)
+{
+    void* (*const routines[])(void*) = {MasterThread, SlaveThread, TraceThread};
+    pthread_t threads[3];
+    int started;
+
+    for(started = 0; started < 3; started++)
+    {
+        int result = pthread_create(&threads[started], NULL, routines[started], NULL);
+
+        if(result != 0)
+        {
+            // без любого из потоков обмен не идет: запущенные останавливаются
+            fprintf(stderr, "pthread_create: %s\n", strerror(result));
+            FSM_StopThreads(threads, started);
+            return 1;
+        }
+    }
+
+    // автоматы работают до завершения процесса; поток журнала останавливается после них
+    pthread_join(threads[0], NULL);
+    pthread_join(threads[1], NULL);
+    FSM_StopThreads(&threads[2], 1);
+    return 0;
+}
+
+#endif
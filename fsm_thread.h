@@ -0,0 +1,11 @@
+#ifndef FSM_THREAD_H
+#define FSM_THREAD_H
+
+#include "fsm.h"
+
+// запуск конечных автоматов ведущего и ведомого в отдельных потоках (THREADED_MODE)
+// поток засыпает, если шаг автомата ничего не изменил, и просыпается по действию соседа или по таймауту
+// возвращает 1, если поток не создан (уже запущенные потоки останавливаются и ожидаются); при успешном запуске не возвращается
+int FSM_RunThreaded(void);
+
+#endif
@@ -1,159 +1,355 @@
 #include "hdlc.h"
-#include <stdio.h>
+#include "simd.h"
+#include "command.h"
+#include "trace.h"
+#include "metrics.h"
+#include "timer.h"
 #include <stdbool.h>
 
+#ifdef CHANNEL_FAULTS
+#include "channel.h"
+#define HDLC_FifoWrite          CHANNEL_WriteByte   // байты кадра проходят через канал с искажениями
+#else
+#define HDLC_FifoWrite          FifoWriteByte
+#endif
 
-hdlc_tx_context_typedef master_tx_context   = {.internal_tx_buffer=USER_INFO_PACK};     // инициализация структуры для отправки ведущим
-hdlc_rx_context_typedef slave_rx_context    = {0};                                      // инициализация структуры для приема ведомым
-hdlc_tx_context_typedef slave_tx_context    = {0};                                      // инициализация структуры для отправки ведомым (отправка ответ)
+
+hdlc_tx_context_typedef master_tx_context   = {.internal_tx_buffer=USER_INFO_PACK,
+                                               .internal_tx_length=HDLC_INFO_SIZE};     // инициализация структуры для отправки ведущим
 hdlc_rx_context_typedef master_rx_context   = {0};                                      // инициализация структуры для приёма ведущим (получение ответа)
 
-// функция для настройки контекста отправляемого сообщения
-void HDLC_TxContextInit(hdlc_tx_context_typedef* tx_context, uint8_t destination_addr, uint8_t cmd) 
+// упаковка N(S)/N(R) в поле нумерации (младший бит первого байта: 0 - I-кадр, 1 - S-кадр)
+static void HDLC_PackSequence(const hdlc_header_typedef* header, uint8_t* sequence)
+{
+#if HDLC_SEQ_MODULO == 8
+    if(header->supervisory)
+        sequence[0] = (uint8_t)(((header->nr & 0x07) << 5) | ((header->control & 0x03) << 2) | 0x01);
+    else
+        sequence[0] = (uint8_t)(((header->nr & 0x07) << 5) | ((header->ns & 0x07) << 1));
+#elif HDLC_SEQ_MODULO == 128
+    if(header->supervisory)
+        sequence[0] = (uint8_t)(((header->control & 0x03) << 2) | 0x01);
+    else
+        sequence[0] = (uint8_t)((header->ns & 0x7F) << 1);
+    sequence[1] = (uint8_t)((header->nr & 0x7F) << 1);
+#else
+    (void)header;
+    (void)sequence;
+#endif
+}
+
+// разбор принятого поля нумерации в N(S)/N(R) (функция S-кадра записывается в control)
+static void HDLC_UnpackSequence(hdlc_packet_typedef* packet, const uint8_t* sequence)
+{
+#if HDLC_SEQ_MODULO == 8
+    packet->nr = sequence[0] >> 5;
+    packet->ns = packet->supervisory ? 0 : ((sequence[0] >> 1) & 0x07);
+    if(packet->supervisory)
+        packet->control = (sequence[0] >> 2) & 0x03;
+#elif HDLC_SEQ_MODULO == 128
+    packet->nr = sequence[1] >> 1;
+    packet->ns = packet->supervisory ? 0 : (sequence[0] >> 1);
+    if(packet->supervisory)
+        packet->control = (sequence[0] >> 2) & 0x03;
+#else
+    // без нумерации S-кадр (только REJ) опознается по управляющему полю при приёме
+    (void)sequence;
+    if(packet->supervisory)
+        packet->control = HDLC_S_REJ;
+#endif
+}
+
+// общая часть настройки контекста отправки
+static void HDLC_TxContextReset(hdlc_tx_context_typedef* tx_context, const hdlc_header_typedef* header)
 {
-    uint8_t fcs_data[HDLC_INFO_SIZE+2];                 // данные для который считается FCS
+    // буффер предыдущего кадра больше не нужен
+    FrameRelease(tx_context->tx_frame);
+    tx_context->tx_frame=NULL;
 
-    // Настройка контекста
     tx_context->tx_stage=TX_STAGE_FD_START;
     tx_context->info_index=0;
+    tx_context->sequence_index=0;
     tx_context->escape_next_byte=false;
-    tx_context->tx_data.address=destination_addr;
-    tx_context->tx_data.control=cmd;
-    memcpy(tx_context->tx_data.information, tx_context->internal_tx_buffer, HDLC_INFO_SIZE);
-
-    // вычисление FCS
-    fcs_data[0]=tx_context->tx_data.address;
-    fcs_data[1]=tx_context->tx_data.control;
-    memcpy(&fcs_data[2], tx_context->tx_data.information, HDLC_INFO_SIZE);
-    HDLC_CalculateFCS(fcs_data, HDLC_INFO_SIZE+2, &tx_context->fcs_msb, &tx_context->fcs_lsb);
+    tx_context->fcs=CRC16_INIT;                         // FCS накапливается по мере отправки байт
+    tx_context->tx_data.address=header->address;
+    tx_context->tx_data.control=header->control;
+    tx_context->tx_data.ns=header->ns;
+    tx_context->tx_data.nr=header->nr;
+    tx_context->tx_data.supervisory=header->supervisory;
+    HDLC_PackSequence(header, tx_context->sequence);
+}
+
+// функция для настройки контекста отправки данных вызывающего без копирования
+void HDLC_TxContextInitBorrowed(hdlc_tx_context_typedef* tx_context, const hdlc_header_typedef* header,
+                                const uint8_t* information, uint32_t info_length)
+{
+    HDLC_TxContextReset(tx_context, header);
+    tx_context->tx_data.information=information;
+    tx_context->tx_data.info_length=header->supervisory ? 0 : info_length;
+}
+
+// функция для настройки контекста отправки буффера пула (контекст становится владельцем до TX_STAGE_COMPLETED)
+void HDLC_TxContextInitFrame(hdlc_tx_context_typedef* tx_context, const hdlc_header_typedef* header, frame_buffer_typedef* frame)
+{
+    HDLC_TxContextInitBorrowed(tx_context, header, frame->data, frame->length);
+    tx_context->tx_frame=FrameRetain(frame);
+}
+
+// функция для настройки контекста отправляемого сообщения
+void HDLC_TxContextInit(hdlc_tx_context_typedef* tx_context, uint8_t destination_addr, uint8_t cmd) 
+{
+    HDLC_TxContextInitSequenced(tx_context, destination_addr, cmd, 0, 0);
+}
+
+// функция для настройки контекста отправляемого I-кадра с номерами N(S) и N(R)
+void HDLC_TxContextInitSequenced(hdlc_tx_context_typedef* tx_context, uint8_t destination_addr, uint8_t cmd, uint8_t ns, uint8_t nr)
+{
+    hdlc_header_typedef header = {.address=destination_addr, .control=cmd, .ns=ns, .nr=nr, .supervisory=false};
+
+    // ответ, подготовленный в буффере принятого кадра, передаётся без копирования: ссылка переходит к передаче
+    if(tx_context->reply_frame != NULL)
+    {
+        HDLC_TxContextInitFrame(tx_context, &header, tx_context->reply_frame);
+        FrameRelease(tx_context->reply_frame);
+        tx_context->reply_frame = NULL;
+        return;
+    }
+
+    // информационное поле передаётся прямо из внутренней памяти узла
+    HDLC_TxContextInitBorrowed(tx_context, &header, tx_context->internal_tx_buffer, tx_context->internal_tx_length);
+}
+
+// функция для настройки контекста отправляемого S-кадра (RR, RNR, REJ, SREJ) с номером N(R)
+void HDLC_TxContextInitSupervisory(hdlc_tx_context_typedef* tx_context, uint8_t destination_addr, hdlc_supervisory_typedef function, uint8_t nr)
+{
+    hdlc_header_typedef header = {.address=destination_addr, .control=(uint8_t)function, .ns=0, .nr=nr, .supervisory=true};
+
+#if HDLC_SEQ_MODULO == 0
+    // без нумерации S-кадр передаётся как кадр с управляющим полем HDLC_REJ_CONTROL без информационного поля
+    (void)function;
+    header.control = HDLC_REJ_CONTROL;
+    header.supervisory = false;
+#endif
+
+    // S-кадр состоит из адреса и поля нумерации: команды и информационного поля нет
+    HDLC_TxContextInitBorrowed(tx_context, &header, NULL, 0);
 }
 
 // функция настройки контекста для принимаемого сообщения
 void HDLC_RxContextInit(hdlc_rx_context_typedef* rx_context)    
 {
+    // буффер, переданный другому владельцу, заменяется новым
+    if(rx_context->rx_frame != NULL && FrameShared(rx_context->rx_frame))
+    {
+        FrameRelease(rx_context->rx_frame);
+        rx_context->rx_frame=NULL;
+    }
+    // буффер берется заранее, чтобы приём не зависел от занятости пула другими владельцами
+    if(rx_context->rx_frame == NULL)
+        rx_context->rx_frame=FrameAlloc();
+
     rx_context->fd_received=false;
     rx_context->frame_assembled=false;
     rx_context->frame_correct=false;                
+    rx_context->skip_frame=false;
     rx_context->buf_index=0;
+    rx_context->header_size=HDLC_HEADER_SIZE;
     rx_context->escape_next_byte=false;
     rx_context->current_byte=0;
     rx_context->rx_data.address=0;
     rx_context->rx_data.control=0;
+    rx_context->rx_data.ns=0;
+    rx_context->rx_data.nr=0;
+    rx_context->rx_data.supervisory=false;
     rx_context->fcs_lsb=0;
     rx_context->fcs_msb=0;
-    memset(rx_context->rx_data.information, 0, HDLC_INFO_SIZE);
-    memset(rx_context->internal_rx_buffer, 0, HDLC_INFO_SIZE+1);
+    rx_context->fcs=CRC16_INIT;
+    rx_context->rx_data.info_length=0;
 }
 
-// расчет FCS для HDLC (доработанный) с https://github.com/jmswu/crc16
+// расчет FCS для HDLC (реализация CRC выбирается в user.h, эталонная - CRC16_UpdateBitwise)
 void HDLC_CalculateFCS(uint8_t *data, int length, uint8_t *fcs_msb, uint8_t *fcs_lsb)  
 {
-    uint16_t crc = 0xFFFF;                                                              // начальное значение HDLC
-    uint8_t i;
-    int count = length;
-
-    while (count-- > 0)
-    {
-        crc = crc ^ (((uint16_t)(*data)) << 8);
-        data++;
-        
-        for (i = 0; i < 8; i++)
-        {
-            if (crc & 0x8000)
-            {
-                crc = (crc << 1) ^ 0x1021;                                              // полином CRC-CCITT
-            }
-            else
-            {
-                crc = crc << 1;
-            }
-        }
-    }
+    uint16_t crc = CRC16_Update(CRC16_INIT, data, (size_t)length);                     // начальное значение HDLC
 
-    crc = crc ^ 0xFFFF;                                                                 // финальное инвертирование для HDLC
+    crc = crc ^ CRC16_XOROUT;                                                           // финальное инвертирование для HDLC
 
     // возвращаем байты в правильном порядке для HDLC
     *fcs_msb = crc & 0xFF;
     *fcs_lsb = (crc >> 8) & 0xFF;
 }
 
-// функция проверки кадра на корректность
-bool HDLC_FrameCorrect(hdlc_rx_context_typedef* rx_context, uint8_t expected_addr, const char* sender_name)
+// запись причины отбрасывания кадра (адрес сохраняется: контекст сбрасывается сразу после ошибки)
+static void HDLC_RxFail(hdlc_rx_context_typedef* rx_context, hdlc_rx_error_typedef error)
 {
-    // проверки на корректность формата сообщения
-    if(rx_context->buf_index != (HDLC_INFO_SIZE+4))
+    rx_context->rx_error = error;
+    rx_context->rx_error_address = rx_context->rx_data.address;
+    METRICS_RxError(rx_context->metrics, error);
+}
+
+// имя причины отбрасывания кадра
+const char* HDLC_RxErrorName(hdlc_rx_error_typedef error)
+{
+    switch(error)
     {
-        printf("%s:\tWrong frame size: (%d bytes, expected %d)\n", sender_name, rx_context->buf_index, HDLC_INFO_SIZE+4);
-        rx_context->frame_correct = false;
-        return false;
+        case HDLC_RX_OK:                return "ok";
+        case HDLC_RX_WRONG_SIZE:        return "wrong_size";
+        case HDLC_RX_WRONG_ADDRESS:     return "wrong_address";
+        case HDLC_RX_UNKNOWN_COMMAND:   return "unknown_command";
+        case HDLC_RX_BAD_FCS:           return "bad_fcs";
+        case HDLC_RX_TOO_LONG:          return "too_long";
+        case HDLC_RX_NO_BUFFER:         return "no_buffer";
+        default:                        return "unknown";
     }
-    if(!rx_context->frame_assembled)
+}
+
+// функция проверки кадра на корректность
+bool HDLC_FrameCorrect(hdlc_rx_context_typedef* rx_context, uint8_t expected_addr)
+{
+    uint32_t overhead = rx_context->header_size + 2;                // заголовок и FCS
+    uint32_t max_size = rx_context->rx_data.supervisory ? overhead : HDLC_INFO_MAX_SIZE + overhead;
+
+    // проверки на корректность формата сообщения (S-кадр не содержит информационного поля)
+    if(rx_context->buf_index < overhead || rx_context->buf_index > max_size)
     {
-        printf("%s:\tFrame not assembled\n", sender_name);
+        TRACE(TRACE_RX_WRONG_SIZE, expected_addr, rx_context->buf_index, overhead);
+        HDLC_RxFail(rx_context, HDLC_RX_WRONG_SIZE);
         rx_context->frame_correct = false;
         return false;
     }
-    if (rx_context->rx_data.address != expected_addr) 
+    if(!rx_context->frame_assembled)
     {
-        printf("%s:\tInvalid destination address (received: 0x%02X, expected: 0x%02X)\n", sender_name, rx_context->rx_data.address, expected_addr);
+        TRACE(TRACE_RX_NOT_ASSEMBLED, expected_addr, 0, 0);
         rx_context->frame_correct = false;
         return false;
     }
-    if (rx_context->rx_data.control != CMD_INVERSING_BYTES && rx_context->rx_data.control != CMD_MIRRORING_BYTES) 
+    if (!rx_context->promiscuous &&
+        rx_context->rx_data.address != expected_addr && rx_context->rx_data.address != HDLC_BROADCAST_ADDR) 
     {
-        printf("%s:\tUnknown command: 0x%02X\n", sender_name, rx_context->rx_data.control);
+        TRACE(TRACE_RX_WRONG_ADDRESS, expected_addr, rx_context->rx_data.address, expected_addr);
+        HDLC_RxFail(rx_context, HDLC_RX_WRONG_ADDRESS);
         rx_context->frame_correct = false;
         return false;
     }
 
-    // Сравнение полученной FCS с расчитанной
+    // Сравнение полученной FCS с накопленной при приёме
     uint16_t received_fcs=(rx_context->fcs_msb<<8)|(rx_context->fcs_lsb);
-    uint8_t fcs_data[HDLC_INFO_SIZE+2];
-    uint8_t calculated_fcs_msb, calculated_fcs_lsb;
-    fcs_data[0]=rx_context->rx_data.address;
-    fcs_data[1]=rx_context->rx_data.control;
-    memcpy(&fcs_data[2], rx_context->rx_data.information, HDLC_INFO_SIZE);
-
-    HDLC_CalculateFCS(fcs_data, 2 + HDLC_INFO_SIZE, &calculated_fcs_msb, &calculated_fcs_lsb);
-    uint16_t calculated_fcs = (calculated_fcs_msb << 8) | calculated_fcs_lsb;
+    uint16_t crc=rx_context->fcs^CRC16_XOROUT;
+    uint16_t calculated_fcs=((crc&0xFF)<<8)|(crc>>8);
 
     if (received_fcs != calculated_fcs) 
     {
-        printf("%s:\tInvalid FCS (received: 0x%04X, calculated: 0x%04X)\n", sender_name, received_fcs, calculated_fcs);
+        TRACE(TRACE_RX_BAD_FCS, expected_addr, received_fcs, calculated_fcs);
+        HDLC_RxFail(rx_context, HDLC_RX_BAD_FCS);
         rx_context->frame_correct = false;
         return false;
     }
 
+    HDLC_UnpackSequence(&rx_context->rx_data, rx_context->sequence);
+
+    if (!rx_context->rx_data.supervisory)
+    {
+        // команда и допустимая длина ее информационного поля - из таблицы команд
+        // (после FCS: ошибка команды относится к неискаженному кадру, и повтор кадра ее не исправит)
+        const command_entry_typedef* command = COMMAND_Lookup(rx_context->rx_data.control);
+
+        if(command == NULL)
+        {
+            TRACE(TRACE_RX_UNKNOWN_COMMAND, expected_addr, rx_context->rx_data.control, 0);
+            HDLC_RxFail(rx_context, HDLC_RX_UNKNOWN_COMMAND);
+            rx_context->frame_correct = false;
+            return false;
+        }
+        if(rx_context->rx_data.info_length > command->max_payload)
+        {
+            TRACE(TRACE_RX_COMMAND_SIZE, expected_addr, rx_context->rx_data.control, rx_context->rx_data.info_length);
+            HDLC_RxFail(rx_context, HDLC_RX_WRONG_SIZE);
+            rx_context->frame_correct = false;
+            return false;
+        }
+    }
+
     rx_context->frame_correct=true;
     return true;
 }
 
-// функция сохранения принятого сообщения во внутренний буффер
-void HDLC_StoreRxData(hdlc_rx_context_typedef* rx_context)
+// функция получения информационного поля проверенного кадра без копирования
+const uint8_t* HDLC_RxPayload(const hdlc_rx_context_typedef* rx_context, uint32_t* info_length)
+{
+    if(!rx_context->frame_assembled || !rx_context->frame_correct)
+    {
+        *info_length = 0;
+        return NULL;
+    }
+    *info_length = rx_context->rx_data.info_length;
+    return rx_context->rx_data.information;
+}
+
+// функция получения буффера проверенного кадра в совместное владение
+frame_buffer_typedef* HDLC_RxTakeFrame(hdlc_rx_context_typedef* rx_context)
+{
+    if(!rx_context->frame_assembled || !rx_context->frame_correct)   return NULL;
+
+    rx_context->rx_frame->length = rx_context->rx_data.info_length;
+    return FrameRetain(rx_context->rx_frame);
+}
+
+// переход к следующему полю передаваемого кадра
+static void HDLC_TxNextStage(hdlc_tx_context_typedef* tx_context)
 {
-    rx_context->internal_rx_buffer[0]=rx_context->rx_data.control;
-    memcpy(&rx_context->internal_rx_buffer[1], rx_context->rx_data.information, HDLC_INFO_SIZE);
+    switch(tx_context->tx_stage)
+    {
+        case TX_STAGE_ADDRESS:          // поле нумерации передаётся только при HDLC_SEQ_MODULO != 0
+            tx_context->tx_stage = (HDLC_SEQ_SIZE > 0) ? TX_STAGE_SEQUENCE : TX_STAGE_CONTROL;
+            break;
+
+#if HDLC_SEQ_SIZE > 0
+        case TX_STAGE_SEQUENCE:         // у S-кадра после поля нумерации сразу идёт FCS
+            tx_context->sequence_index++;
+            if(tx_context->sequence_index >= HDLC_SEQ_SIZE)
+                tx_context->tx_stage = tx_context->tx_data.supervisory ? TX_STAGE_FCS_MSB : TX_STAGE_CONTROL;
+            break;
+#endif
+
+        case TX_STAGE_INFORMATION:
+            if(tx_context->info_index >= tx_context->tx_data.info_length)
+                tx_context->tx_stage = TX_STAGE_FCS_MSB;
+            break;
+
+        default:
+            tx_context->tx_stage++;
+
+            // кадр передан - буффер пула возвращается
+            if(tx_context->tx_stage == TX_STAGE_COMPLETED)
+            {
+                if(tx_context->metrics != NULL)
+                {
+                    METRICS_Add(tx_context->metrics, METRICS_TX_FRAMES, 1);
+                    METRICS_Add(tx_context->metrics, METRICS_TX_BYTES,
+                                HDLC_OVERHEAD_SIZE - (tx_context->tx_data.supervisory ? 1u : 0u) + tx_context->tx_data.info_length);
+                    METRICS_Record(tx_context->metrics, METRICS_HIST_ENCODE, GetCurrentTimeNs() - tx_context->start_ns);
+                }
+                FrameRelease(tx_context->tx_frame);
+                tx_context->tx_frame = NULL;
+            }
+            break;
+    }
 }
 
 // функция отправки одно байта в FIFO
 void HDLC_SendByte(hdlc_tx_context_typedef* tx_context, fifo_typedef* fifo)
 {
+    // байт выбирается (и учитывается в FCS) только при наличии места в FIFO
+    if(FifoIsFull(fifo))    return;
+
     // обработка ESCAPE последовательности
     if (tx_context->escape_next_byte) 
     {
-        if(FifoIsFull(fifo))    return;
-        FifoWriteByte(fifo, tx_context->current_byte ^ 0x20);
+        HDLC_FifoWrite(fifo, tx_context->current_byte ^ 0x20);
         tx_context->escape_next_byte = false;
     
         // переход к следующему полю
-        if(tx_context->tx_stage != TX_STAGE_INFORMATION) 
-        {
-            tx_context->tx_stage++;
-        } 
-        else if (tx_context->info_index >= HDLC_INFO_SIZE) 
-        {
-            tx_context->tx_stage=TX_STAGE_FCS_MSB;
-        }
+        HDLC_TxNextStage(tx_context);
         return;
     }
 
@@ -162,20 +358,30 @@ void HDLC_SendByte(hdlc_tx_context_typedef* tx_context, fifo_typedef* fifo)
     {
         case TX_STAGE_FD_START:     // флаг FD
             tx_context->current_byte = HDLC_FD_FLAG;
+            if(tx_context->metrics != NULL)
+                tx_context->start_ns = GetCurrentTimeNs();
             break;
 
         case TX_STAGE_ADDRESS:     // адрес
             tx_context->current_byte = tx_context->tx_data.address;
+            tx_context->fcs = CRC16_UpdateByte(tx_context->fcs, tx_context->current_byte);
+            break;
+
+        case TX_STAGE_SEQUENCE:    // поле нумерации N(S)/N(R)
+            tx_context->current_byte = tx_context->sequence[tx_context->sequence_index];
+            tx_context->fcs = CRC16_UpdateByte(tx_context->fcs, tx_context->current_byte);
             break;
 
         case TX_STAGE_CONTROL:     // управляющее поле
             tx_context->current_byte = tx_context->tx_data.control;
+            tx_context->fcs = CRC16_UpdateByte(tx_context->fcs, tx_context->current_byte);
             break;
 
         case TX_STAGE_INFORMATION:     // информационное поле
-            if(tx_context->info_index < HDLC_INFO_SIZE) 
+            if(tx_context->info_index < tx_context->tx_data.info_length) 
             {
                 tx_context->current_byte = tx_context->tx_data.information[tx_context->info_index];
+                tx_context->fcs = CRC16_UpdateByte(tx_context->fcs, tx_context->current_byte);
                 tx_context->info_index++;
             } 
             else 
@@ -186,6 +392,9 @@ void HDLC_SendByte(hdlc_tx_context_typedef* tx_context, fifo_typedef* fifo)
             break;
 
         case TX_STAGE_FCS_MSB:     // старший байт FCS
+            tx_context->fcs ^= CRC16_XOROUT;                    // финальное инвертирование для HDLC
+            tx_context->fcs_msb = tx_context->fcs & 0xFF;
+            tx_context->fcs_lsb = (tx_context->fcs >> 8) & 0xFF;
             tx_context->current_byte = tx_context->fcs_msb;
             break;
 
@@ -207,15 +416,15 @@ void HDLC_SendByte(hdlc_tx_context_typedef* tx_context, fifo_typedef* fifo)
         if(tx_context->tx_stage == TX_STAGE_FD_START || tx_context->tx_stage == TX_STAGE_FD_END)      // флаги начала и конца кадра не байтстаффятся
         {
             if(FifoIsFull(fifo)) return;
-            FifoWriteByte(fifo, tx_context->current_byte);             
+            HDLC_FifoWrite(fifo, tx_context->current_byte);             
             
-            tx_context->tx_stage++;
+            HDLC_TxNextStage(tx_context);
         } 
         else 
         {
             if(FifoIsFull(fifo)) return;
             // применяем байтстаффинг
-            FifoWriteByte(fifo, HDLC_ESCAPE);
+            HDLC_FifoWrite(fifo, HDLC_ESCAPE);
             tx_context->escape_next_byte = true;
         }
     }
@@ -223,40 +432,96 @@ void HDLC_SendByte(hdlc_tx_context_typedef* tx_context, fifo_typedef* fifo)
     {
         // Обычный байт без байтстаффинга
         if(FifoIsFull(fifo)) return;
-        FifoWriteByte(fifo, tx_context->current_byte);
+        HDLC_FifoWrite(fifo, tx_context->current_byte);
         
         // Переход к следующему полю
-        if(tx_context->tx_stage == TX_STAGE_INFORMATION) 
-        {
-            if(tx_context->info_index >= HDLC_INFO_SIZE) 
-            {
-                tx_context->tx_stage = TX_STAGE_FCS_MSB;
-            }
-        } 
-        else 
-        {
-            tx_context->tx_stage++;
-        }
+        HDLC_TxNextStage(tx_context);
     }
-    #ifdef TX_MORE_INFO 
-    printf("Transmitted:\t%02X\n", tx_context->current_byte);
-    #endif
+    TRACE(TRACE_TX_BYTE, TRACE_LINK_BUS, tx_context->tx_data.address, tx_context->current_byte);
 }
 
-// функция приёма одно байта из FIFO
-void HDLC_ReceiveByte(hdlc_rx_context_typedef* rx_context, fifo_typedef* fifo, uint8_t expected_addr, const char* sender_name)
+// запись кадра в буффер пользователя
+typedef struct
 {
-    // проверки корректности
-    if(FifoIsEmpty(fifo))                               return;
-    if(rx_context->frame_assembled)                     return;
-    if(rx_context->buf_index >= HDLC_INFO_SIZE + 5)     return;
+    uint8_t* data;                                          // буффер
+    size_t size;                                            // размер буффера
+    size_t written;                                         // всего записано
+} hdlc_writer_typedef;
 
-    FifoReadByte(fifo, &rx_context->current_byte);
+// копирование в буффер записи (возвращает 0, если места не хватило)
+static bool HDLC_WriterPut(hdlc_writer_typedef* writer, const uint8_t* data, size_t length)
+{
+    if(writer->size - writer->written < length)     return false;
+
+    memcpy(&writer->data[writer->written], data, length);
+    writer->written += length;
+    return true;
+}
+
+// байтстаффинг блока: участки без 0x7E/0x7D копируются целиком
+static bool HDLC_WriterStuff(hdlc_writer_typedef* writer, const uint8_t* data, size_t length)
+{
+    while(length > 0)
+    {
+        size_t run = SIMD_FindEscapable(data, length);     // длина участка без байтстаффинга
+
+        if(!HDLC_WriterPut(writer, data, run))  return false;
+        data += run;
+        length -= run;
+
+        if(length == 0)                         break;
+        uint8_t escaped[2] = {HDLC_ESCAPE, *data ^ 0x20};
+        if(!HDLC_WriterPut(writer, escaped, 2)) return false;
+        data++;
+        length--;
+    }
+    return true;
+}
+
+// кодирование кадра в буффер записи (возвращает 0, если места не хватило)
+static bool HDLC_WriterEncode(hdlc_writer_typedef* writer, const hdlc_header_typedef* frame_header, const uint8_t* information, uint32_t info_length)
+{
+    const uint8_t flag = HDLC_FD_FLAG;
+    uint8_t header[HDLC_HEADER_SIZE];                       // адрес, поле нумерации и управляющее поле
+    size_t header_size = 1 + HDLC_SEQ_SIZE;
+    uint8_t fcs[2];                                         // FCS в порядке передачи
+
+    if(info_length > HDLC_INFO_MAX_SIZE)                            return false;
+    if(frame_header->supervisory && info_length > 0)                return false;
+
+    header[0] = frame_header->address;
+    HDLC_PackSequence(frame_header, &header[1]);
+    if(!frame_header->supervisory)
+        header[header_size++] = frame_header->control;
+
+    uint16_t crc = CRC16_Update(CRC16_INIT, header, header_size);
+    crc = CRC16_Update(crc, information, info_length) ^ CRC16_XOROUT;
+    fcs[0] = crc & 0xFF;
+    fcs[1] = (crc >> 8) & 0xFF;
+
+    return HDLC_WriterPut(writer, &flag, 1) &&
+           HDLC_WriterStuff(writer, header, header_size) &&
+           HDLC_WriterStuff(writer, information, info_length) &&
+           HDLC_WriterStuff(writer, fcs, 2) &&
+           HDLC_WriterPut(writer, &flag, 1);
+}
+
+// функция кодирования целого кадра (FD, байтстаффинг, FCS, FD) в буффер за один вызов
+size_t HDLC_EncodeFrame(const hdlc_header_typedef* header, const uint8_t* information, uint32_t info_length,
+                        uint8_t* out, size_t out_size)
+{
+    hdlc_writer_typedef writer = {.data = out, .size = out_size, .written = 0};
+
+    if(!HDLC_WriterEncode(&writer, header, information, info_length))
+        return 0;
+    return writer.written;
+}
+
+// обработка одного принятого байта (общая часть побайтового и блочного приёма)
+static void HDLC_RxProcessByte(hdlc_rx_context_typedef* rx_context, uint8_t byte, uint8_t expected_addr)
+{
+    rx_context->current_byte = byte;
 
-    #ifdef RX_MORE_INFO
-    printf("Received:\t%02X\n", rx_context->current_byte);
-    #endif
-    
     // обработка ESCAPE последовательности
     if(rx_context->escape_next_byte) 
     {
@@ -273,93 +538,268 @@ void HDLC_ReceiveByte(hdlc_rx_context_typedef* rx_context, fifo_typedef* fifo, u
         // проверяем на FD
         if (rx_context->current_byte == HDLC_FD_FLAG) 
         {
-            if(rx_context->fd_received) 
+            if(rx_context->skip_frame)
+            {
+                // конец чужого кадра - ожидаем следующий
+                HDLC_RxContextInit(rx_context);
+            }
+            else if(rx_context->fd_received && rx_context->buf_index == 0)
+            {
+                // флаги подряд (заполнение линии или флаг, оставшийся от искаженного кадра) - кадр только начинается;
+                // иначе флаг начала кадра закрыл бы пустой кадр, а флаг конца открыл бы следующий
+                return;
+            }
+            else if(rx_context->fd_received) 
             {
                 rx_context->frame_assembled = true;
-                printf("%s:\tFD received - end of frame\n", sender_name);
+                TRACE(TRACE_RX_FRAME_END, expected_addr, rx_context->buf_index, 0);
+
+                // длина информационного поля определяется закрывающим флагом
+                if(rx_context->buf_index >= rx_context->header_size + 2)
+                {
+                    rx_context->rx_data.info_length = rx_context->buf_index - rx_context->header_size - 2;
+                }
 
                 // проверка FCS
-                if(HDLC_FrameCorrect(rx_context, expected_addr, sender_name))
+                if(HDLC_FrameCorrect(rx_context, expected_addr))
                 {
-                    printf("%s:\tFrame validated successfully!\n", sender_name);
+                    TRACE(TRACE_RX_FRAME_OK, expected_addr, rx_context->rx_data.info_length, 0);
+                    if(rx_context->metrics != NULL)
+                    {
+                        METRICS_Add(rx_context->metrics, METRICS_RX_FRAMES, 1);
+                        METRICS_Add(rx_context->metrics, METRICS_RX_BYTES, rx_context->buf_index);
+                        METRICS_Record(rx_context->metrics, METRICS_HIST_DECODE, GetCurrentTimeNs() - rx_context->start_ns);
+                    }
+                }
+                else if(rx_context->rx_error == HDLC_RX_UNKNOWN_COMMAND)
+                {
+                    // кадр принят без искажений: остается собранным, чтобы ведомый ответил CMD_ERROR
+                    TRACE(TRACE_RX_FRAME_FAILED, expected_addr, 0, 0);
                 }
                 else
                 {
-                    printf("%s:\tFrame validation failed!\n", sender_name);
+                    TRACE(TRACE_RX_FRAME_FAILED, expected_addr, 0, 0);
                     HDLC_RxContextInit(rx_context);
                 }
             } 
             else
             {
+                // информационное поле принимается в буффер пула (если при инициализации пул был пуст)
+                if(rx_context->rx_frame == NULL)
+                    rx_context->rx_frame = FrameAlloc();
+                if(rx_context->rx_frame == NULL)
+                {
+                    TRACE(TRACE_RX_NO_BUFFER, expected_addr, 0, 0);
+                    HDLC_RxFail(rx_context, HDLC_RX_NO_BUFFER);
+                    rx_context->fd_received = true;
+                    rx_context->skip_frame = true;
+                    return;
+                }
+                rx_context->rx_data.information = rx_context->rx_frame->data;
+
                 rx_context->fd_received = true;
                 rx_context->buf_index = 0;
+                rx_context->header_size = HDLC_HEADER_SIZE;
+                rx_context->fcs = CRC16_INIT;
                 rx_context->frame_correct=false;
-                printf("%s:\tNew message detected! Start receiving...\n", sender_name);
-                printf("%s:\tFD received - start of frame\n", sender_name);
+                if(rx_context->metrics != NULL)
+                    rx_context->start_ns = GetCurrentTimeNs();
+                TRACE(TRACE_RX_FRAME_START, expected_addr, 0, 0);
             }
             return;
         }
     }
 
     // обработка данных (для всех кроме FD и ESC)
-    if(rx_context->fd_received && !rx_context->escape_next_byte)
+    if(rx_context->fd_received && !rx_context->escape_next_byte && !rx_context->skip_frame)
     {
+        // кадр длиннее допустимого - ждём следующий флаг FD
+        if(rx_context->buf_index >= HDLC_INFO_MAX_SIZE + rx_context->header_size + 2)
+        {
+            TRACE(TRACE_RX_TOO_LONG, expected_addr, 0, 0);
+            HDLC_RxFail(rx_context, HDLC_RX_TOO_LONG);
+            HDLC_RxContextInit(rx_context);
+            return;
+        }
+
         if(rx_context->buf_index == 0)
         {                          
             rx_context->rx_data.address = rx_context->current_byte;
-            printf("%s:\tAddress received\n", sender_name);
+            rx_context->fcs = CRC16_UpdateByte(rx_context->fcs, rx_context->current_byte);
+
+            // кадр другому узлу отбрасывается сразу, без приёма и проверки FCS
+            if(!rx_context->promiscuous &&
+               rx_context->current_byte != expected_addr && rx_context->current_byte != HDLC_BROADCAST_ADDR)
+            {
+                // ведомым чужие кадры шины - норма; ведущему адресованы все ответы, чужой адрес - искажение
+                if(expected_addr == HDLC_MASTER_ADDR)
+                    HDLC_RxFail(rx_context, HDLC_RX_WRONG_ADDRESS);
+                rx_context->skip_frame = true;
+                TRACE(TRACE_RX_SKIP, expected_addr, rx_context->current_byte, 0);
+                return;
+            }
+            TRACE(TRACE_RX_ADDRESS, expected_addr, 0, 0);
         }
-        else if(rx_context->buf_index == 1)                     
+#if HDLC_SEQ_SIZE > 0
+        else if(rx_context->buf_index <= HDLC_SEQ_SIZE)
         {
-            rx_context->rx_data.control = rx_context->current_byte;
-            printf("%s:\tCommand received\n", sender_name);
-        }
-        else if(rx_context->buf_index < HDLC_INFO_SIZE + 2)
-        {     
-            rx_context->rx_data.information[rx_context->buf_index - 2] = rx_context->current_byte;
-
-            if (rx_context->buf_index == HDLC_INFO_SIZE + 1)
-                printf("%s:\tInformation received\n", sender_name);
+            rx_context->sequence[rx_context->buf_index - 1] = rx_context->current_byte;
+            rx_context->fcs = CRC16_UpdateByte(rx_context->fcs, rx_context->current_byte);
 
+            // младший бит первого байта нумерации: S-кадр не содержит команды
+            if(rx_context->buf_index == 1)
+            {
+                rx_context->rx_data.supervisory = (rx_context->current_byte & 0x01) != 0;
+                rx_context->header_size = rx_context->rx_data.supervisory ? HDLC_HEADER_SIZE - 1 : HDLC_HEADER_SIZE;
+            }
+        }
+#endif
+        else if(rx_context->buf_index < rx_context->header_size)
+        {
+            rx_context->rx_data.control = rx_context->current_byte;
+            rx_context->fcs = CRC16_UpdateByte(rx_context->fcs, rx_context->current_byte);
+            TRACE(TRACE_RX_COMMAND, expected_addr, 0, 0);
+#if HDLC_SEQ_SIZE == 0
+            // без нумерации S-кадр REJ отличается от команды только управляющим полем
+            rx_context->rx_data.supervisory = (rx_context->current_byte == HDLC_REJ_CONTROL);
+#endif
         }
-        else if(rx_context->buf_index == HDLC_INFO_SIZE + 2)
+        else if(rx_context->buf_index == rx_context->header_size)
         {
             rx_context->fcs_msb = rx_context->current_byte;
-            printf("%s:\tFCS MSB received\n", sender_name);
         }
-        else if(rx_context->buf_index == HDLC_INFO_SIZE + 3) 
+        else if(rx_context->buf_index == rx_context->header_size + 1)
+        {
+            rx_context->fcs_lsb = rx_context->current_byte;
+        }
+        else
         {
+            // два последних байта - кандидаты в FCS, байт, вышедший из них, принадлежит информационному полю
+            rx_context->rx_data.information[rx_context->buf_index - rx_context->header_size - 2] = rx_context->fcs_msb;
+            rx_context->fcs = CRC16_UpdateByte(rx_context->fcs, rx_context->fcs_msb);
+            rx_context->fcs_msb = rx_context->fcs_lsb;
             rx_context->fcs_lsb = rx_context->current_byte;
-            printf("%s:\tFCS LSB received\n", sender_name); 
         }
         rx_context->buf_index++;
     }
 }
 
-// функция выполнения принятой команды
-void ProcessCommand(hdlc_rx_context_typedef* rx_context, hdlc_tx_context_typedef* tx_context)   
+// добавление участка без FD/ESC к телу кадра (после заголовка и первых двух байт)
+static void HDLC_RxAppendRun(hdlc_rx_context_typedef* rx_context, const uint8_t* data, size_t length)
+{
+    uint8_t* info = &rx_context->rx_data.information[rx_context->buf_index - rx_context->header_size - 2];
+
+    if(length == 1)
+    {
+        info[0] = rx_context->fcs_msb;
+        rx_context->fcs = CRC16_UpdateByte(rx_context->fcs, rx_context->fcs_msb);
+        rx_context->fcs_msb = rx_context->fcs_lsb;
+        rx_context->fcs_lsb = data[0];
+    }
+    else
+    {
+        // два байта линии задержки и участок без последних двух байт уходят в информационное поле
+        info[0] = rx_context->fcs_msb;
+        info[1] = rx_context->fcs_lsb;
+        memcpy(&info[2], data, length - 2);
+        rx_context->fcs = CRC16_Update(rx_context->fcs, info, length);
+        rx_context->fcs_msb = data[length - 2];
+        rx_context->fcs_lsb = data[length - 1];
+    }
+    rx_context->buf_index += (uint32_t)length;
+}
+
+// функция блочного приёма из непрерывного участка байт
+size_t HDLC_ReceiveBlock(hdlc_rx_context_typedef* rx_context, const uint8_t* data, size_t length, uint8_t expected_addr)
 {
-    switch (rx_context->internal_rx_buffer[0])
+    size_t consumed = 0;
+
+    while(consumed < length && !rx_context->frame_assembled)
     {
-        case CMD_INVERSING_BYTES:           // инверсия байтов
-            printf("Slave:\tProcessing command 0x%02X: Inversing bytes\n", rx_context->internal_rx_buffer[0]);
-            for(int i=0; i<HDLC_INFO_SIZE; i++)
+        // участки без FD/ESC обрабатываются целиком
+        if(!rx_context->escape_next_byte)
+        {
+            if(!rx_context->fd_received || rx_context->skip_frame)
             {
-                tx_context->internal_tx_buffer[i]=~rx_context->internal_rx_buffer[i+1];
+                // до флага FD и в чужом кадре байты не используются
+                consumed += SIMD_FindEscapable(&data[consumed], length - consumed);
+                if(consumed == length)  break;
             }
-            break;
-        
-        case CMD_MIRRORING_BYTES:           // отражение байтов
-            printf("Slave:\tProcessing command 0x%02X: Mirroring bytes\n", rx_context->internal_rx_buffer[0]);
-            for(int i=0; i<HDLC_INFO_SIZE; i++)
+            else if(rx_context->buf_index >= rx_context->header_size + 2)
             {
-                tx_context->internal_tx_buffer[i]=rx_context->internal_rx_buffer[HDLC_INFO_SIZE-i];
+                size_t run = SIMD_FindEscapable(&data[consumed], length - consumed);
+                size_t space = HDLC_INFO_MAX_SIZE + rx_context->header_size + 2 - rx_context->buf_index;
+
+                if(run > space)
+                    run = space;                    // переполнение обработает побайтовый путь
+                if(run > 0)
+                {
+                    HDLC_RxAppendRun(rx_context, &data[consumed], run);
+                    consumed += run;
+                    continue;
+                }
             }
-            break;
+        }
 
-        default:
-            printf("Slave:\tUnknown command 0x%02X\n", rx_context->internal_rx_buffer[0]);
-            memcpy(tx_context->internal_tx_buffer, &rx_context->internal_rx_buffer[1], HDLC_INFO_SIZE);
-            break;
+        HDLC_RxProcessByte(rx_context, data[consumed++], expected_addr);
     }
-}
\ No newline at end of file
+    return consumed;
+}
+
+// функция приёма одно байта из FIFO
+void HDLC_ReceiveByte(hdlc_rx_context_typedef* rx_context, fifo_typedef* fifo, uint8_t expected_addr)
+{
+    // проверки корректности
+    if(FifoIsEmpty(fifo))                               return;
+    if(rx_context->frame_assembled)                     return;
+
+    FifoReadByte(fifo, &rx_context->current_byte);
+
+    TRACE(TRACE_RX_BYTE, expected_addr, rx_context->current_byte, 0);
+
+    HDLC_RxProcessByte(rx_context, rx_context->current_byte, expected_addr);
+}
+
+// функция выполнения принятой команды
+uint8_t ProcessCommand(hdlc_rx_context_typedef* rx_context, hdlc_tx_context_typedef* tx_context)   
+{
+    uint32_t length;                                                    // длина информационного поля
+    const uint8_t* payload = HDLC_RxPayload(rx_context, &length);       // информационное поле принятого кадра
+    uint8_t command = rx_context->rx_data.control;
+    const command_entry_typedef* entry = COMMAND_Lookup(command);
+
+    if(!rx_context->frame_assembled)    return command;
+
+    // ответ на предыдущий кадр, так и не отправленный, больше не нужен
+    FrameRelease(tx_context->reply_frame);
+    tx_context->reply_frame = NULL;
+
+    if(entry == NULL)
+    {
+        // повтор запроса не поможет (REJ зациклил бы обмен): окончательный ответ об ошибке
+        TRACE(TRACE_SLAVE_UNKNOWN_COMMAND, rx_context->rx_data.address, command, 0);
+        tx_context->internal_tx_buffer[0] = command;
+        tx_context->internal_tx_buffer[1] = COMMAND_STATUS_UNKNOWN;
+        tx_context->internal_tx_length = 2;
+        return CMD_ERROR;
+    }
+    if(payload == NULL)     return command;
+
+    TRACE(TRACE_SLAVE_COMMAND, rx_context->rx_data.address, command, 0);
+    if(entry->flags & COMMAND_IN_PLACE)
+    {
+        // результат записывается поверх принятого поля, буффер пула становится ответом (на широковещательный кадр ответа нет)
+        uint32_t reply_length = entry->handler(rx_context->rx_frame->data, payload, length, entry->arg);
+
+        if(rx_context->rx_data.address != HDLC_BROADCAST_ADDR)
+        {
+            tx_context->reply_frame = HDLC_RxTakeFrame(rx_context);
+            tx_context->reply_frame->length = reply_length;
+        }
+        return command;
+    }
+
+    // результат записывается сразу в память ответа, который затем отправляется без копирования
+    tx_context->internal_tx_length = entry->handler(tx_context->internal_tx_buffer, payload, length, entry->arg);
+    return command;
+}
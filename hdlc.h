@@ -3,30 +3,106 @@
 
 #include "fifo.h"
 #include "user.h"
+#include "crc.h"
+#include "pool.h"
 
 #define HDLC_MASTER_ADDR        0x01                    // адресс ведущего HDLC
-#define HDLC_SLAVE_ADDR         0x02                    // адрес ведомого HDLC
+#define HDLC_SLAVE_ADDR         0x02                    // адрес первого ведомого HDLC (остальные ведомые шины - следующие адреса)
+#define HDLC_BROADCAST_ADDR     0xFF                    // широковещательный адрес HDLC (принимают все ведомые, ответа нет)
 #define HDLC_FD_FLAG            0x7E                    // флаг протокола HDLC
 #define HDLC_ESCAPE             0x7D                    // ESCAPE последовательность байтстаффинга HDLC
 
+// поле нумерации I/S-кадров (N(S), N(R)) между адресом и командой
+#if HDLC_SEQ_MODULO == 128
+#define HDLC_SEQ_SIZE           2                       // расширенный режим: два байта нумерации
+#elif HDLC_SEQ_MODULO == 8
+#define HDLC_SEQ_SIZE           1                       // основной режим: один байт нумерации
+#elif HDLC_SEQ_MODULO == 0
+#define HDLC_SEQ_SIZE           0                       // без нумерации: управляющее поле содержит только команду
+#else
+#error "HDLC_SEQ_MODULO должен быть 0, 8 или 128"
+#endif
+
+#if HDLC_SEQ_MODULO
+#define HDLC_SEQ_NEXT(n)            ((uint8_t)(((n) + 1) & (HDLC_SEQ_MODULO - 1)))              // следующий номер по модулю
+#define HDLC_SEQ_DISTANCE(from, to) ((uint8_t)(((to) - (from)) & (HDLC_SEQ_MODULO - 1)))        // расстояние от from до to по модулю
+#endif
+
+#define HDLC_HEADER_SIZE        (2 + HDLC_SEQ_SIZE)     // адрес, поле нумерации и команда
+
+#if HDLC_SEQ_MODULO == 0
+// без нумерации из S-кадров передаётся только REJ: управляющее поле S-кадра REJ с N(R)=0
+// (поля RR, RNR и SREJ совпали бы с командами), информационного поля нет
+#define HDLC_REJ_CONTROL        0x09
+#endif
+#define HDLC_OVERHEAD_SIZE      (HDLC_HEADER_SIZE + 2)  // заголовок и два байта FCS
+#define HDLC_ENCODED_MAX_SIZE(info_length)  (2 + 2*((info_length) + HDLC_OVERHEAD_SIZE))    // размер кадра на линии в худшем случае (все байты экранированы)
+
 
-typedef enum                            // перечисление команд HDLC
+typedef enum                            // перечисление встроенных команд HDLC (собственные команды - COMMAND_Register)
 {
     CMD_INVERSING_BYTES = 0x01,         // команда инверсии байт
-    CMD_MIRRORING_BYTES = 0x02          // команда отражения байт (байт 1 на место n, байт n на место байта 1 и т.д.)
+    CMD_MIRRORING_BYTES = 0x02,         // команда отражения байт (байт 1 на место n, байт n на место байта 1 и т.д.)
+    CMD_AGGREGATE       = 0x03,         // пакет команд: информационное поле - последовательность подкоманд (command.h)
+    CMD_ERROR           = 0x04          // ответ ведомого на невыполнимую команду: информационное поле - команда запроса и command_status_typedef
 } hdlc_command_typedef;
 
+typedef enum                            // перечисление функций S-кадра (поле control S-кадра)
+{
+    HDLC_S_RR   = 0x00,                 // готов к приёму (подтверждение до N(R)-1)
+    HDLC_S_RNR  = 0x01,                 // не готов к приёму
+    HDLC_S_REJ  = 0x02,                 // отказ: повторить начиная с N(R)
+    HDLC_S_SREJ = 0x03                  // выборочный отказ
+} hdlc_supervisory_typedef;
+
+typedef enum                            // причина отбрасывания последнего принятого кадра
+{
+    HDLC_RX_OK = 0,                     // ошибок не было
+    HDLC_RX_WRONG_SIZE,                 // длина кадра меньше заголовка с FCS или больше допустимой для его типа
+    HDLC_RX_WRONG_ADDRESS,              // кадр другому узлу
+    HDLC_RX_UNKNOWN_COMMAND,            // неизвестная команда неискаженного I-кадра (кадр остается собранным, frame_correct = false)
+    HDLC_RX_BAD_FCS,                    // FCS не совпала
+    HDLC_RX_TOO_LONG,                   // информационное поле длиннее HDLC_INFO_MAX_SIZE (кадр пропущен до флага FD)
+    HDLC_RX_NO_BUFFER,                  // нет свободного буффера пула (кадр пропущен до флага FD)
+    HDLC_RX_ERROR_COUNT                 // количество значений
+} hdlc_rx_error_typedef;
+
+typedef struct                              // заголовок кадра HDLC (для блочного кодирования)
+{
+    uint8_t address;                        // адрес HDLC
+    uint8_t control;                        // команда (I-кадр) или функция S-кадра
+    uint8_t ns;                             // N(S) - номер кадра (при HDLC_SEQ_MODULO != 0)
+    uint8_t nr;                             // N(R) - номер следующего ожидаемого кадра
+    bool supervisory;                       // S-кадр: без команды и информационного поля
+} hdlc_header_typedef;
+
 typedef struct                              // структура полезных данных пакета HDLC (нет флагов FD и FCS)
 {
     uint8_t address;                        // адрес HDLC
-    uint8_t control;                        // управляющее поле HDLC
-    uint8_t information[HDLC_INFO_SIZE];    // информационное поле HDLC
+    uint8_t control;                        // управляющее поле HDLC (команда или функция S-кадра)
+    uint8_t ns;                             // N(S) - номер кадра (при HDLC_SEQ_MODULO != 0)
+    uint8_t nr;                             // N(R) - номер следующего ожидаемого кадра
+    bool supervisory;                       // S-кадр: без команды и информационного поля
+    uint8_t* information;                   // информационное поле HDLC (буффер пула в контексте приёма)
+    uint32_t info_length;                   // фактическая длина информационного поля
 } hdlc_packet_typedef;
 
+typedef struct                              // структура отправляемого пакета HDLC (информационное поле не копируется)
+{
+    uint8_t address;                        // адрес HDLC
+    uint8_t control;                        // управляющее поле HDLC (команда или функция S-кадра)
+    uint8_t ns;                             // N(S) - номер кадра (при HDLC_SEQ_MODULO != 0)
+    uint8_t nr;                             // N(R) - номер следующего ожидаемого кадра
+    bool supervisory;                       // S-кадр: без команды и информационного поля
+    const uint8_t* information;             // заимствованное информационное поле (не изменяется до TX_STAGE_COMPLETED)
+    uint32_t info_length;                   // длина информационного поля
+} hdlc_tx_packet_typedef;
+
 typedef enum                        // перечисление стадий отправки сообщения
 {
     TX_STAGE_FD_START=0,            // флаг FD - начало кадра
     TX_STAGE_ADDRESS,               // адресс
+    TX_STAGE_SEQUENCE,              // поле нумерации N(S)/N(R) (при HDLC_SEQ_MODULO != 0)
     TX_STAGE_CONTROL,               // управляющее поле
     TX_STAGE_INFORMATION,           // информационное поле
     TX_STAGE_FCS_MSB,               // FCS старший байт
@@ -35,16 +111,26 @@ typedef enum                        // перечисление стадий о
     TX_STAGE_COMPLETED              // все стадии пройдены
 } hdlc_tx_stage_typedef;
 
+struct metrics_link;                            // метрики узла (metrics.h)
+
 typedef struct                                  // структура для промежуточных данных передачи кадра
 {
     hdlc_tx_stage_typedef tx_stage;             // текущая стадия передачи данных
     uint8_t current_byte;                       // номер байта, который мы отправляем
-    hdlc_packet_typedef tx_data;                // сами данные (кроме флагов FD и FCS)
-    uint8_t info_index;                         // индекс для передачи данных информационного поля
+    hdlc_tx_packet_typedef tx_data;             // сами данные (кроме флагов FD и FCS)
+    uint32_t info_index;                        // индекс для передачи данных информационного поля
+    uint8_t sequence[2];                        // поле нумерации в порядке передачи
+    uint8_t sequence_index;                     // индекс для передачи поля нумерации
     uint8_t fcs_msb;                            // контрольная сумма старший байт
     uint8_t fcs_lsb;                            // контрольная сумма младший байт
-    uint8_t internal_tx_buffer[HDLC_INFO_SIZE]; // внутренняя память узла для отправляемых данных (информационное поле)
+    uint16_t fcs;                               // текущее значение CRC (накапливается по мере отправки)
+    uint8_t internal_tx_buffer[HDLC_INFO_MAX_SIZE]; // внутренняя память узла для отправляемых данных (информационное поле)
+    uint32_t internal_tx_length;                // длина данных во внутренней памяти на отправку
+    frame_buffer_typedef* tx_frame;             // буффер пула, удерживаемый до TX_STAGE_COMPLETED (NULL - данные заимствованы)
+    frame_buffer_typedef* reply_frame;          // ответ, подготовленный в буффере принятого кадра (NULL - ответ во внутренней памяти)
     bool escape_next_byte;                      // флаг байтстаффинга 
+    struct metrics_link* metrics;               // учет отправленных кадров (NULL - без учета), задается владельцем контекста
+    uint64_t start_ns;                          // время записи первого байта кадра в FIFO (при учете в метриках)
 } hdlc_tx_context_typedef;
 
 typedef struct                                      // структура для промежуточных данных приёма кадра
@@ -52,13 +138,22 @@ typedef struct                                      // структура для
     bool fd_received;                               // флаг принятого флага FD
     bool frame_assembled;                           // флаг собранного сообщения
     bool frame_correct;                             // флаг корректного кадра
+    bool skip_frame;                                // кадр адресован другому узлу - байты пропускаются до флага FD
     hdlc_packet_typedef rx_data;                    // полезная часть данных (без FD и FCS)
-    uint8_t buf_index;                              // индекс для записи в буффер rx_data
+    frame_buffer_typedef* rx_frame;                 // буффер пула для информационного поля (берется при флаге FD начала кадра)
+    uint32_t buf_index;                             // количество принятых байт кадра (без FD)
+    uint32_t header_size;                           // размер заголовка принимаемого кадра (у S-кадра нет команды)
+    uint8_t sequence[2];                            // принятое поле нумерации
     uint8_t current_byte;                           // текущий прочитанный байт
-    uint8_t fcs_msb;                                // контрольная сумма старший байт
-    uint8_t fcs_lsb;                                // контрольная сумма младший байт
-    uint8_t internal_rx_buffer[HDLC_INFO_SIZE+1];   // внутренняя память узла для принимаемых данных (комманда+информационное поле)
+    uint8_t fcs_msb;                                // контрольная сумма старший байт (до конца кадра - предпоследний принятый байт)
+    uint8_t fcs_lsb;                                // контрольная сумма младший байт (до конца кадра - последний принятый байт)
+    uint16_t fcs;                                   // текущее значение CRC (накапливается по мере приёма)
     bool escape_next_byte;                          // флаг байтстаффинга
+    bool promiscuous;                               // приём кадров любого адреса (анализ записи линии), не сбрасывается HDLC_RxContextInit
+    hdlc_rx_error_typedef rx_error;                 // причина отбрасывания последнего кадра (сбрасывает вызывающий, HDLC_RxContextInit не изменяет)
+    uint8_t rx_error_address;                       // адрес отброшенного кадра
+    struct metrics_link* metrics;                   // учет принятых и отброшенных кадров (NULL - без учета), не сбрасывается HDLC_RxContextInit
+    uint64_t start_ns;                              // время флага начала кадра (при учете в метриках)
 } hdlc_rx_context_typedef;
 
 // extern uint8_t internal_master_tx_buffer[];             // внутренняя память ведущего на отправку (содержит информационное поле)
@@ -67,35 +162,66 @@ typedef struct                                      // структура для
 // extern uint8_t internal_master_rx_buffer[];             // внутренняя память ведущего на приём (содержит команду и информационное поле)
 
 extern hdlc_tx_context_typedef master_tx_context;      // структура для отправки ведущим
-extern hdlc_rx_context_typedef slave_rx_context;       // структура для приема ведомым
-extern hdlc_tx_context_typedef slave_tx_context;       // структура для отправки ведомым (отправка ответ)
 extern hdlc_rx_context_typedef master_rx_context;      // структура для приёма ведущим (получение ответа)
 
 // функция для настройки контекста отправляемого сообщения
 void HDLC_TxContextInit(hdlc_tx_context_typedef* tx_context, uint8_t destination_addr, uint8_t cmd);
 
+// функция для настройки контекста отправляемого I-кадра с номерами N(S) и N(R)
+void HDLC_TxContextInitSequenced(hdlc_tx_context_typedef* tx_context, uint8_t destination_addr, uint8_t cmd, uint8_t ns, uint8_t nr);
+
+// функция для настройки контекста отправляемого S-кадра (RR, RNR, REJ, SREJ) с номером N(R)
+void HDLC_TxContextInitSupervisory(hdlc_tx_context_typedef* tx_context, uint8_t destination_addr, hdlc_supervisory_typedef function, uint8_t nr);
+
+// функция для настройки контекста отправки данных вызывающего без копирования
+// буффер information заимствуется и не должен изменяться до TX_STAGE_COMPLETED
+void HDLC_TxContextInitBorrowed(hdlc_tx_context_typedef* tx_context, const hdlc_header_typedef* header,
+                                const uint8_t* information, uint32_t info_length);
+
+// функция для настройки контекста отправки буффера пула (контекст становится владельцем до TX_STAGE_COMPLETED)
+void HDLC_TxContextInitFrame(hdlc_tx_context_typedef* tx_context, const hdlc_header_typedef* header, frame_buffer_typedef* frame);
+
 // функция настройки контекста для принимаемого сообщения
 void HDLC_RxContextInit(hdlc_rx_context_typedef* rx_context);    
 
-// расчет fcs для HDLC (доработанный) с https://github.com/jmswu/crc16
+// расчет FCS для HDLC (реализация CRC выбирается в user.h)
 void HDLC_CalculateFCS(uint8_t *data, int length, uint8_t *fcs_msb, uint8_t *fcs_lsb);  
 
-// функция сохранения принятого сообщения во внутренний буффер
-void HDLC_StoreRxData(hdlc_rx_context_typedef* rx_context);
+// функция получения информационного поля проверенного кадра без копирования (NULL, если кадр не принят)
+// указатель действителен до следующего HDLC_RxContextInit или приёма следующего кадра
+const uint8_t* HDLC_RxPayload(const hdlc_rx_context_typedef* rx_context, uint32_t* info_length);
+
+// функция получения буффера проверенного кадра в совместное владение (NULL, если кадр не принят)
+// вызывающий освобождает буффер FrameRelease, контекст приёма берет для следующего кадра другой буффер
+frame_buffer_typedef* HDLC_RxTakeFrame(hdlc_rx_context_typedef* rx_context);
 
 // функция отправки одно байта в FIFO
 void HDLC_SendByte(hdlc_tx_context_typedef* tx_context, fifo_typedef* fifo);
 
+// функция кодирования целого кадра (FD, байтстаффинг, FCS, FD) в буффер за один вызов
+// возвращает количество записанных байт или 0, если буффера не хватило
+size_t HDLC_EncodeFrame(const hdlc_header_typedef* header, const uint8_t* information, uint32_t info_length,
+                        uint8_t* out, size_t out_size);
+
 // функция приёма одно байта из FIFO
-void HDLC_ReceiveByte(hdlc_rx_context_typedef* rx_context, fifo_typedef* fifo, uint8_t expected_addr, const char* sender_name);
+void HDLC_ReceiveByte(hdlc_rx_context_typedef* rx_context, fifo_typedef* fifo, uint8_t expected_addr);
+
+// функция блочного приёма из непрерывного участка байт (поиск FD/ESC векторный, байтстаффинг снимается участками)
+// останавливается после собранного кадра, возвращает количество обработанных байт
+size_t HDLC_ReceiveBlock(hdlc_rx_context_typedef* rx_context, const uint8_t* data, size_t length, uint8_t expected_addr);
+
+// имя причины отбрасывания кадра ("ok", "bad_fcs" и т.д.)
+const char* HDLC_RxErrorName(hdlc_rx_error_typedef error);
 
 // функция проверки корректности кадра
-bool HDLC_FrameCorrect(hdlc_rx_context_typedef* rx_context, uint8_t expected_addr, const char* sender_name);
+bool HDLC_FrameCorrect(hdlc_rx_context_typedef* rx_context, uint8_t expected_addr);
 
 // функция проверки нового сообщения
 bool HDLC_CheckNewMessage(fifo_typedef* fifo);
 
-// функция выполнения принятой команды
-void ProcessCommand(hdlc_rx_context_typedef* rx_context, hdlc_tx_context_typedef* tx_context);
+// функция выполнения принятой команды по таблице команд (command.h)
+// ответ команды COMMAND_IN_PLACE остается в буффере принятого кадра и отправляется следующим HDLC_TxContextInit
+// возвращает команду ответа: команду запроса или CMD_ERROR, если команда не зарегистрирована
+uint8_t ProcessCommand(hdlc_rx_context_typedef* rx_context, hdlc_tx_context_typedef* tx_context);
 
 #endif
@@ -3,28 +3,78 @@
 #include "hdlc.h"
 #include "fsm.h"
 #include "timer.h"
+#include "simd.h"
+#include "fsm_thread.h"
+#include "fsm_process.h"
+#include "trace.h"
+#include "channel.h"
+#include "metrics.h"
+#include "command.h"
 
 
 fifo_typedef fifo_mts = {0};      // FIFO Master To Slave
 fifo_typedef fifo_stm = {0};      // FIFO Slave To Master
 
+#ifdef CHANNEL_FAULTS
+static channel_typedef channel_mts;     // искажения кадров ведущего
+static channel_typedef channel_stm;     // искажения ответов ведомых
+#endif
+
 
 int main()
 {
     FifoInit(&fifo_mts);        // инициализация FIFO master to slave
     FifoInit(&fifo_stm);        // инициализация FIFO slave to master
 
-    printf("Master<-->Slave simulation starting...\n");
+    // проверка выбранной реализации CRC по эталонной
+    if(!CRC16_SelfTest())
+    {
+        printf("CRC self-test failed!\n");
+        return 1;
+    }
+    if(!METRICS_SelfTest())
+    {
+        printf("Metrics self-test failed!\n");
+        return 1;
+    }
+    if(!COMMAND_SelfTest())
+    {
+        printf("Command batch self-test failed!\n");
+        return 1;
+    }
+    FSM_MasterPreparePayload();     // информационное поле ведущего (пакет подкоманд при CMD_AGGREGATE)
+
+    #ifdef CHANNEL_FAULTS
+    const channel_profile_typedef profile = CHANNEL_PROFILE;
+
+    CHANNEL_Init(&channel_mts, &profile, CHANNEL_SEED);
+    CHANNEL_Init(&channel_stm, &profile, CHANNEL_SEED + 1);
+    CHANNEL_Attach(&channel_mts, &fifo_mts);
+    CHANNEL_Attach(&channel_stm, &fifo_stm);
+    #endif
+
+    METRICS_Init();             // счетчики узлов (до запуска потоков и процессов)
+    TRACE_Init();               // уровень журнала из переменной окружения HDLC_TRACE_LEVEL
+    SIMD_Init();                // выбор реализаций обработки байт по возможностям процессора
+    printf("Master<-->Slave simulation starting (byte kernels: %s)...\n", SIMD_KernelName());
+
+    #ifdef THREADED_MODE
+    return FSM_RunThreaded();   // ведущий и ведомый в отдельных потоках (1 - поток не создан)
+    #endif
+
+    #ifdef PROCESS_MODE
+    return FSM_RunProcesses();  // ведущий и ведомый в отдельных процессах (до закрытия линии)
+    #endif
 
     while(1)
     {
         FSM_Master();   // конечный автомат ведущего
         FSM_Slave();    // конечный автомат ведомого
 
-        #ifdef MORE_FIFO_INFO
-        DebugFifoState(&fifo_mts, "MTS");
-        DebugFifoState(&fifo_stm, "STM");
-        #endif
+        TRACE(TRACE_FIFO_MTS_STATE, TRACE_LINK_BUS, FifoReadCounter(&fifo_mts), FifoWriteCounter(&fifo_mts));
+        TRACE(TRACE_FIFO_STM_STATE, TRACE_LINK_BUS, FifoReadCounter(&fifo_stm), FifoWriteCounter(&fifo_stm));
+        TRACE_Drain(stdout);    // вывод журнала накопленных событий
+        METRICS_Poll();         // периодический снимок метрик
     }
     
     return 0; 
@@ -0,0 +1,277 @@
+#include "metrics.h"
+#include "timer.h"
+#include <string.h>
+
+#ifdef LINUX
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+static metrics_link_typedef metrics_local[METRICS_LINK_COUNT];     // метрики процесса (до METRICS_Init и без PROCESS_MODE)
+metrics_link_typedef* metrics_links = metrics_local;
+
+static metrics_snapshot_typedef metrics_snapshot;                   // снимок для выгрузки (METRICS_Publish)
+#if defined(LINUX) && defined(METRICS_SHM_PATH)
+static metrics_snapshot_typedef* metrics_shared = NULL;             // страница общей памяти для внешнего читателя
+#endif
+
+// функция размещения метрик (в PROCESS_MODE - в общей памяти процессов) и открытия страницы METRICS_SHM_PATH
+void METRICS_Init(void)
+{
+#if defined(LINUX) && defined(PROCESS_MODE)
+    // процессы ведущего и ведомых после fork считают в одни и те же счетчики
+    metrics_link_typedef* shared = mmap(NULL, sizeof(metrics_local), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    if(shared != MAP_FAILED)
+        metrics_links = shared;
+#endif
+
+    for(uint32_t i = 0; i < METRICS_LINK_COUNT; i++)
+        metrics_links[i].address = (uint8_t)((i == 0) ? HDLC_MASTER_ADDR : HDLC_SLAVE_ADDR + i - 1);
+
+#if defined(LINUX) && defined(METRICS_SHM_PATH)
+    int fd = open(METRICS_SHM_PATH, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+
+    if(fd >= 0 && ftruncate(fd, sizeof(metrics_snapshot_typedef)) == 0)
+    {
+        metrics_shared = mmap(NULL, sizeof(metrics_snapshot_typedef), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if(metrics_shared == MAP_FAILED)
+            metrics_shared = NULL;
+    }
+    if(fd >= 0)
+        close(fd);
+    if(metrics_shared == NULL)
+        perror(METRICS_SHM_PATH);
+    else
+    {
+        // страница могла остаться от прошлого запуска: снимок недействителен, пока не записан
+        atomic_store_explicit(&metrics_shared->sequence, 1, memory_order_relaxed);
+        metrics_shared->magic = METRICS_MAGIC;
+        metrics_shared->version = METRICS_VERSION;
+        metrics_shared->link_count = METRICS_LINK_COUNT;
+    }
+#endif
+}
+
+// приём кадра узлом expected_addr: сколько кадров засчитано как wrong_address
+static uint64_t MetricsWrongAddress(const uint8_t* data, size_t length, uint8_t expected_addr)
+{
+    metrics_link_typedef link;
+    hdlc_rx_context_typedef rx_context = {0};
+
+    memset(&link, 0, sizeof(link));
+    rx_context.metrics = &link;
+    HDLC_RxContextInit(&rx_context);
+    HDLC_ReceiveBlock(&rx_context, data, length, expected_addr);
+    FrameRelease(rx_context.rx_frame);
+    return atomic_load_explicit(&link.rx_error[HDLC_RX_WRONG_ADDRESS], memory_order_relaxed);
+}
+
+// проверка учета отброшенных кадров: кадр чужому адресу засчитывается ведущему и не засчитывается ведомому
+bool METRICS_SelfTest(void)
+{
+    static const uint8_t information[] = {0x11, 0x22, 0x33};
+    const hdlc_header_typedef header = {.address=HDLC_SLAVE_ADDR, .control=USER_COMMAND};
+    uint8_t encoded[HDLC_ENCODED_MAX_SIZE(sizeof(information))];
+    size_t length = HDLC_EncodeFrame(&header, information, sizeof(information), encoded, sizeof(encoded));
+
+    if(length == 0)
+        return false;
+    if(MetricsWrongAddress(encoded, length, HDLC_MASTER_ADDR) != 1)             // ответ с искаженным адресом
+        return false;
+    if(MetricsWrongAddress(encoded, length, HDLC_SLAVE_ADDR + 1) != 0)          // запрос другому ведомому шины
+        return false;
+    return true;
+}
+
+// функция снятия снимка всех узлов
+// счетчики читаются по одному: снимок согласован с точностью до событий, пришедшихся на время чтения
+void METRICS_Snapshot(metrics_snapshot_typedef* snapshot)
+{
+    snapshot->magic = METRICS_MAGIC;
+    snapshot->version = METRICS_VERSION;
+    snapshot->link_count = METRICS_LINK_COUNT;
+    snapshot->timestamp_ns = GetCurrentTimeNs();
+
+    for(uint32_t i = 0; i < METRICS_LINK_COUNT; i++)
+    {
+        metrics_link_typedef* link = &metrics_links[i];
+
+        snapshot->link[i].address = link->address;
+        for(uint32_t j = 0; j < METRICS_COUNTER_COUNT; j++)
+            snapshot->link[i].counter[j] = atomic_load_explicit(&link->counter[j], memory_order_relaxed);
+        for(uint32_t j = 0; j < HDLC_RX_ERROR_COUNT; j++)
+            snapshot->link[i].rx_error[j] = atomic_load_explicit(&link->rx_error[j], memory_order_relaxed);
+        for(uint32_t j = 0; j < METRICS_HIST_COUNT; j++)
+        {
+            metrics_histogram_typedef* histogram = &link->histogram[j];
+            metrics_histogram_snapshot_typedef* copy = &snapshot->link[i].histogram[j];
+
+            copy->count = atomic_load_explicit(&histogram->count, memory_order_relaxed);
+            copy->sum = atomic_load_explicit(&histogram->sum, memory_order_relaxed);
+            copy->max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+            for(uint32_t k = 0; k < METRICS_HIST_BUCKETS; k++)
+                copy->bucket[k] = atomic_load_explicit(&histogram->bucket[k], memory_order_relaxed);
+        }
+    }
+}
+
+// имя счетчика
+const char* METRICS_CounterName(metrics_counter_typedef counter)
+{
+    switch(counter)
+    {
+        case METRICS_TX_FRAMES:     return "tx_frames";
+        case METRICS_TX_BYTES:      return "tx_bytes";
+        case METRICS_RX_FRAMES:     return "rx_frames";
+        case METRICS_RX_BYTES:      return "rx_bytes";
+        case METRICS_REPLIES:       return "replies";
+        case METRICS_TIMEOUTS:      return "timeouts";
+        case METRICS_RETRANSMITS:   return "retransmits";
+        case METRICS_FIFO_FULL:     return "fifo_full";
+        case METRICS_FIFO_EMPTY:    return "fifo_empty";
+        default:                    return "unknown";
+    }
+}
+
+// имя гистограммы
+const char* METRICS_HistogramName(metrics_hist_typedef histogram)
+{
+    switch(histogram)
+    {
+        case METRICS_HIST_REPLY:    return "reply_ns";
+        case METRICS_HIST_ENCODE:   return "encode_ns";
+        case METRICS_HIST_DECODE:   return "decode_ns";
+        default:                    return "unknown";
+    }
+}
+
+// функция оценки процентиля (0..100) по гистограмме снимка: верхняя граница интервала, не больше max
+uint64_t METRICS_Percentile(const metrics_histogram_snapshot_typedef* histogram, double percent)
+{
+    uint64_t total = 0;
+    uint64_t rank;
+    uint64_t seen = 0;
+
+    // счетчики интервалов и count читаются не одновременно - ранг считается по интервалам
+    for(uint32_t i = 0; i < METRICS_HIST_BUCKETS; i++)
+        total += histogram->bucket[i];
+    if(total == 0)
+        return 0;
+
+    rank = (uint64_t)(percent / 100.0 * (double)total + 0.5);
+    if(rank == 0)
+        rank = 1;
+    for(uint32_t i = 0; i < METRICS_HIST_BUCKETS; i++)
+    {
+        seen += histogram->bucket[i];
+        if(seen >= rank)
+        {
+            uint64_t high = (i + 1 < METRICS_HIST_BUCKETS) ? METRICS_BucketLow(i + 1) - 1 : histogram->max;
+
+            return (high < histogram->max) ? high : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+// функция записи снимка в JSON
+void METRICS_WriteJson(const metrics_snapshot_typedef* snapshot, FILE* out)
+{
+    fprintf(out, "{\"timestamp_ns\": %llu, \"links\": [", (unsigned long long)snapshot->timestamp_ns);
+    for(uint32_t i = 0; i < snapshot->link_count; i++)
+    {
+        fprintf(out, "%s\n  {\"address\": %u", i ? "," : "", (unsigned)snapshot->link[i].address);
+        for(uint32_t j = 0; j < METRICS_COUNTER_COUNT; j++)
+            fprintf(out, ", \"%s\": %llu", METRICS_CounterName(j), (unsigned long long)snapshot->link[i].counter[j]);
+
+        fprintf(out, ",\n   \"rx_errors\": {");
+        for(uint32_t j = HDLC_RX_OK + 1; j < HDLC_RX_ERROR_COUNT; j++)
+            fprintf(out, "%s\"%s\": %llu", (j > HDLC_RX_OK + 1) ? ", " : "", HDLC_RxErrorName(j),
+                    (unsigned long long)snapshot->link[i].rx_error[j]);
+        fprintf(out, "}");
+
+        // непустые интервалы - парами [наименьшее значение, количество]
+        for(uint32_t j = 0; j < METRICS_HIST_COUNT; j++)
+        {
+            const metrics_histogram_snapshot_typedef* histogram = &snapshot->link[i].histogram[j];
+            bool first = true;
+
+            fprintf(out, ",\n   \"%s\": {\"count\": %llu, \"sum\": %llu, \"max\": %llu, "
+                    "\"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"p999\": %llu, \"buckets\": [",
+                    METRICS_HistogramName(j), (unsigned long long)histogram->count, (unsigned long long)histogram->sum,
+                    (unsigned long long)histogram->max,
+                    (unsigned long long)METRICS_Percentile(histogram, 50.0), (unsigned long long)METRICS_Percentile(histogram, 90.0),
+                    (unsigned long long)METRICS_Percentile(histogram, 99.0), (unsigned long long)METRICS_Percentile(histogram, 99.9));
+            for(uint32_t k = 0; k < METRICS_HIST_BUCKETS; k++)
+            {
+                if(histogram->bucket[k] == 0)
+                    continue;
+                fprintf(out, "%s[%llu, %llu]", first ? "" : ", ", (unsigned long long)METRICS_BucketLow(k),
+                        (unsigned long long)histogram->bucket[k]);
+                first = false;
+            }
+            fprintf(out, "]}");
+        }
+        fprintf(out, "}");
+    }
+    fprintf(out, "\n]}\n");
+}
+
+#ifdef METRICS_FILE
+// запись снимка во временный файл и замена METRICS_FILE: читатель видит только целые снимки
+static void MetricsWriteFile(const metrics_snapshot_typedef* snapshot)
+{
+    FILE* out = fopen(METRICS_FILE ".tmp", "w");
+
+    if(out == NULL)
+        return;
+    METRICS_WriteJson(snapshot, out);
+    if(fclose(out) != 0)
+        return;
+#ifdef WINDOWS
+    remove(METRICS_FILE);                           // rename в Windows не заменяет существующий файл
+#endif
+    rename(METRICS_FILE ".tmp", METRICS_FILE);
+}
+#endif
+
+// функция выгрузки снимка в METRICS_FILE и METRICS_SHM_PATH (что включено в user.h)
+void METRICS_Publish(void)
+{
+    METRICS_Snapshot(&metrics_snapshot);
+
+#ifdef METRICS_FILE
+    MetricsWriteFile(&metrics_snapshot);
+#endif
+
+#if defined(LINUX) && defined(METRICS_SHM_PATH)
+    if(metrics_shared != NULL)
+    {
+        uint32_t sequence = atomic_load_explicit(&metrics_shared->sequence, memory_order_relaxed);
+
+        // нечетный счетчик на время записи: читатель, заставший запись, повторит чтение
+        sequence |= 1;
+        atomic_store_explicit(&metrics_shared->sequence, sequence, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        metrics_shared->timestamp_ns = metrics_snapshot.timestamp_ns;
+        memcpy(metrics_shared->link, metrics_snapshot.link, sizeof(metrics_snapshot.link));
+        atomic_store_explicit(&metrics_shared->sequence, sequence + 1, memory_order_release);
+    }
+#endif
+}
+
+// функция периодической выгрузки: снимок выгружается, если с прошлой выгрузки прошло METRICS_PERIOD_MS
+void METRICS_Poll(void)
+{
+#if defined(METRICS_FILE) || (defined(LINUX) && defined(METRICS_SHM_PATH))
+    static uint64_t metrics_next_us = 0;            // время следующей выгрузки
+    uint64_t now = GetCurrentTimeUs();
+
+    if(now < metrics_next_us)
+        return;
+    metrics_next_us = now + (uint64_t)METRICS_PERIOD_MS * 1000u;
+    METRICS_Publish();
+#endif
+}
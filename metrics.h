@@ -0,0 +1,189 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "user.h"
+#include "hdlc.h"
+
+// метрики узлов: счетчики и гистограммы времени, всегда включены (одно атомарное сложение на кадр или событие)
+// обновляются из любого потока (relaxed), в PROCESS_MODE - из обоих процессов (память метрик общая, METRICS_Init до fork)
+// снимок всех узлов выгружается раз в METRICS_PERIOD_MS в файл JSON (METRICS_FILE) и/или в страницу общей памяти (METRICS_SHM_PATH)
+//
+// чтение снимка из общей памяти внешней программой (seqlock, запись не ждет читателей):
+//   1. s1 = sequence (acquire); нечетное значение - идет запись, повторить
+//   2. скопировать metrics_snapshot_typedef
+//   3. s2 = sequence (после acquire-барьера); s1 != s2 - снимок изменился во время копирования, повторить
+//
+// wrong_address считается только у ведущего: ему адресованы все ответы, и кадр с чужим адресом - искаженный ответ.
+// ведомые пропускают кадры других ведомых общей шины без учета (это не ошибка), приём без фильтра адреса
+// (promiscuous, hdlc_capture) адрес не проверяет
+
+#define METRICS_LINK_COUNT      (HDLC_SLAVE_COUNT + 1)  // ведущий (индекс 0) и ведомые
+#define METRICS_HIST_SUB_BITS   3                       // 2^3 линейных интервала на каждую степень двойки (погрешность до 12.5%)
+#define METRICS_HIST_MAX_BITS   40                      // значения до 2^40 нс (около 18 минут), большие попадают в последний интервал
+#define METRICS_HIST_BUCKETS    ((METRICS_HIST_MAX_BITS - METRICS_HIST_SUB_BITS + 1) << METRICS_HIST_SUB_BITS)
+#define METRICS_MAGIC           0x534D4448u             // "HDMS" в начале снимка
+#define METRICS_VERSION         2                       // версия формата metrics_snapshot_typedef
+#define METRICS_CACHE_LINE      64                      // счетчики узлов на разных кэш-линиях
+
+typedef enum                                            // счетчики узла
+{
+    METRICS_TX_FRAMES,                                  // отправлено кадров
+    METRICS_TX_BYTES,                                   // отправлено байт кадров (без флагов и байтстаффинга)
+    METRICS_RX_FRAMES,                                  // принято корректных кадров
+    METRICS_RX_BYTES,                                   // принято байт корректных кадров (без флагов и байтстаффинга)
+    METRICS_REPLIES,                                    // принято ответов на команды (ведущий, без S-кадров)
+    METRICS_TIMEOUTS,                                   // истекших таймаутов ответа (подтверждения)
+    METRICS_RETRANSMITS,                                // повторно переданных кадров
+    METRICS_FIFO_FULL,                                  // шагов автомата, пропущенных из-за полного FIFO передачи
+    METRICS_FIFO_EMPTY,                                 // шагов автомата, заставших FIFO приёма пустым
+    METRICS_COUNTER_COUNT
+} metrics_counter_typedef;
+
+typedef enum                                            // гистограммы времени узла (нс)
+{
+    METRICS_HIST_REPLY,                                 // запрос-ответ: от окончания передачи кадра до приёма ответа (ведущий)
+    METRICS_HIST_ENCODE,                                // кодирование кадра: от первого до последнего байта в FIFO (с ожиданием места)
+    METRICS_HIST_DECODE,                                // разбор кадра: от флага начала до флага конца (с ожиданием байт)
+    METRICS_HIST_COUNT
+} metrics_hist_typedef;
+
+typedef struct                                          // гистограмма с логарифмическими интервалами (как HDR Histogram)
+{
+    _Atomic uint64_t count;                             // значений
+    _Atomic uint64_t sum;                               // сумма значений
+    _Atomic uint64_t max;                               // наибольшее значение
+    _Atomic uint64_t bucket[METRICS_HIST_BUCKETS];      // значений в каждом интервале
+} metrics_histogram_typedef;
+
+typedef struct metrics_link                             // метрики одного узла (адрес как у журнала событий)
+{
+    _Alignas(METRICS_CACHE_LINE) uint8_t address;       // адрес узла
+    _Atomic uint64_t counter[METRICS_COUNTER_COUNT];    // счетчики
+    _Atomic uint64_t rx_error[HDLC_RX_ERROR_COUNT];     // отброшенных кадров по причинам (HDLC_RX_OK не используется)
+    metrics_histogram_typedef histogram[METRICS_HIST_COUNT];
+} metrics_link_typedef;
+
+typedef struct                                          // гистограмма в снимке
+{
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t bucket[METRICS_HIST_BUCKETS];
+} metrics_histogram_snapshot_typedef;
+
+typedef struct                                          // снимок всех узлов (формат страницы общей памяти)
+{
+    uint32_t magic;                                     // METRICS_MAGIC
+    uint32_t version;                                   // METRICS_VERSION
+    _Atomic uint32_t sequence;                          // счетчик записи seqlock: нечетный во время записи
+    uint32_t link_count;                                // узлов в снимке
+    uint64_t timestamp_ns;                              // время снимка (монотонные часы)
+    struct
+    {
+        uint64_t address;
+        uint64_t counter[METRICS_COUNTER_COUNT];
+        uint64_t rx_error[HDLC_RX_ERROR_COUNT];
+        metrics_histogram_snapshot_typedef histogram[METRICS_HIST_COUNT];
+    } link[METRICS_LINK_COUNT];
+} metrics_snapshot_typedef;
+
+extern metrics_link_typedef* metrics_links;             // метрики узлов (METRICS_LINK_COUNT)
+
+// функция размещения метрик (в PROCESS_MODE - в общей памяти процессов) и открытия страницы METRICS_SHM_PATH
+void METRICS_Init(void);
+
+// проверка учета отброшенных кадров: кадр чужому адресу засчитывается ведущему и не засчитывается ведомому
+bool METRICS_SelfTest(void);
+
+// функция снятия снимка всех узлов
+void METRICS_Snapshot(metrics_snapshot_typedef* snapshot);
+
+// функция выгрузки снимка в METRICS_FILE и METRICS_SHM_PATH (что включено в user.h)
+void METRICS_Publish(void);
+
+// функция периодической выгрузки: снимок выгружается, если с прошлой выгрузки прошло METRICS_PERIOD_MS
+void METRICS_Poll(void);
+
+// функция записи снимка в JSON
+void METRICS_WriteJson(const metrics_snapshot_typedef* snapshot, FILE* out);
+
+// имя счетчика и гистограммы (для JSON)
+const char* METRICS_CounterName(metrics_counter_typedef counter);
+const char* METRICS_HistogramName(metrics_hist_typedef histogram);
+
+// функция оценки процентиля (0..100) по гистограмме снимка: верхняя граница интервала, не больше max
+uint64_t METRICS_Percentile(const metrics_histogram_snapshot_typedef* histogram, double percent);
+
+// метрики узла по адресу (NULL - адрес не ведущего и не ведомого)
+static inline metrics_link_typedef* METRICS_Link(uint8_t address)
+{
+    if(address == HDLC_MASTER_ADDR)
+        return &metrics_links[0];
+    if(address >= HDLC_SLAVE_ADDR && address < HDLC_SLAVE_ADDR + HDLC_SLAVE_COUNT)
+        return &metrics_links[1 + address - HDLC_SLAVE_ADDR];
+    return NULL;
+}
+
+// увеличение счетчика узла (link = NULL - без учета)
+static inline void METRICS_Add(metrics_link_typedef* link, metrics_counter_typedef counter, uint64_t value)
+{
+    if(link != NULL)
+        atomic_fetch_add_explicit(&link->counter[counter], value, memory_order_relaxed);
+}
+
+// учет отброшенного кадра
+static inline void METRICS_RxError(metrics_link_typedef* link, hdlc_rx_error_typedef error)
+{
+    if(link != NULL && error < HDLC_RX_ERROR_COUNT)
+        atomic_fetch_add_explicit(&link->rx_error[error], 1, memory_order_relaxed);
+}
+
+// интервал гистограммы: до 2^SUB_BITS - по одному значению, дальше 2^SUB_BITS интервалов на степень двойки
+static inline uint32_t METRICS_Bucket(uint64_t value)
+{
+    uint32_t top;
+    uint32_t shift;
+
+    if(value < (1u << METRICS_HIST_SUB_BITS))
+        return (uint32_t)value;
+    top = (uint32_t)(63 - __builtin_clzll(value));
+    if(top >= METRICS_HIST_MAX_BITS)
+        return METRICS_HIST_BUCKETS - 1;
+    shift = top - METRICS_HIST_SUB_BITS;
+    return ((shift + 1) << METRICS_HIST_SUB_BITS) + (uint32_t)((value >> shift) & ((1u << METRICS_HIST_SUB_BITS) - 1));
+}
+
+// наименьшее значение интервала
+static inline uint64_t METRICS_BucketLow(uint32_t bucket)
+{
+    uint32_t shift;
+
+    if(bucket < (1u << METRICS_HIST_SUB_BITS))
+        return bucket;
+    shift = (bucket >> METRICS_HIST_SUB_BITS) - 1;
+    return (uint64_t)((bucket & ((1u << METRICS_HIST_SUB_BITS) - 1)) | (1u << METRICS_HIST_SUB_BITS)) << shift;
+}
+
+// учет значения в гистограмме узла
+static inline void METRICS_Record(metrics_link_typedef* link, metrics_hist_typedef id, uint64_t value)
+{
+    metrics_histogram_typedef* histogram;
+    uint64_t max;
+
+    if(link == NULL)
+        return;
+    histogram = &link->histogram[id];
+    atomic_fetch_add_explicit(&histogram->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->sum, value, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->bucket[METRICS_Bucket(value)], 1, memory_order_relaxed);
+
+    max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+    while(value > max && !atomic_compare_exchange_weak_explicit(&histogram->max, &max, value, memory_order_relaxed, memory_order_relaxed))
+        ;
+}
+
+#endif
@@ -0,0 +1,87 @@
+#include "pool.h"
+#include <stddef.h>
+
+static frame_buffer_typedef frame_pool[FRAME_POOL_SIZE];       // память всех буфферов пула
+static uint32_t frame_pool_used = 0;                            // буфферов, ни разу не выданных из памяти пула
+static frame_buffer_typedef* frame_free_list = NULL;            // возвращенные в пул буфферы
+static uint32_t frame_available = FRAME_POOL_SIZE;              // количество свободных буфферов
+static atomic_flag frame_pool_lock = ATOMIC_FLAG_INIT;          // защита списка (ведущий и ведомый могут работать в разных потоках)
+
+// захват списка свободных буфферов
+static inline void FramePoolLock(void)
+{
+    while(atomic_flag_test_and_set_explicit(&frame_pool_lock, memory_order_acquire))
+    {
+    }
+}
+
+// освобождение списка свободных буфферов
+static inline void FramePoolUnlock(void)
+{
+    atomic_flag_clear_explicit(&frame_pool_lock, memory_order_release);
+}
+
+// функция получения буффера из пула (владелец один; NULL - свободных буфферов нет)
+frame_buffer_typedef* FrameAlloc(void)
+{
+    frame_buffer_typedef* frame = NULL;
+
+    FramePoolLock();
+    if(frame_free_list != NULL)
+    {
+        frame = frame_free_list;
+        frame_free_list = frame->next_free;
+    }
+    else if(frame_pool_used < FRAME_POOL_SIZE)
+    {
+        frame = &frame_pool[frame_pool_used++];             // первое использование буффера
+    }
+    if(frame != NULL)
+        frame_available--;
+    FramePoolUnlock();
+
+    if(frame != NULL)
+    {
+        frame->length = 0;
+        frame->next_free = NULL;
+        atomic_store_explicit(&frame->refcount, 1, memory_order_relaxed);
+    }
+    return frame;
+}
+
+// функция добавления владельца буффера (возвращает тот же буффер)
+frame_buffer_typedef* FrameRetain(frame_buffer_typedef* frame)
+{
+    atomic_fetch_add_explicit(&frame->refcount, 1, memory_order_relaxed);
+    return frame;
+}
+
+// функция отказа от владения буффером (последний владелец возвращает буффер в пул)
+void FrameRelease(frame_buffer_typedef* frame)
+{
+    if(frame == NULL)   return;
+    if(atomic_fetch_sub_explicit(&frame->refcount, 1, memory_order_acq_rel) != 1)   return;
+
+    FramePoolLock();
+    frame->next_free = frame_free_list;
+    frame_free_list = frame;
+    frame_available++;
+    FramePoolUnlock();
+}
+
+// функция проверки, есть ли у буффера другие владельцы
+bool FrameShared(frame_buffer_typedef* frame)
+{
+    return atomic_load_explicit(&frame->refcount, memory_order_acquire) > 1;
+}
+
+// функция получения количества свободных буфферов пула
+uint32_t FramePoolAvailable(void)
+{
+    uint32_t available;
+
+    FramePoolLock();
+    available = frame_available;
+    FramePoolUnlock();
+    return available;
+}
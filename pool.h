@@ -0,0 +1,35 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "user.h"
+
+// пул буфферов кадров: память выделяется заранее (FRAME_POOL_SIZE буфферов), malloc не используется
+// буффер освобождается, когда последний владелец (окно передачи, контекст передачи/приёма, очередь) вызовет FrameRelease
+
+typedef struct frame_buffer                 // буффер информационного поля кадра
+{
+    uint8_t data[HDLC_INFO_MAX_SIZE];       // информационное поле
+    uint32_t length;                        // длина информационного поля
+    atomic_uint refcount;                   // количество владельцев буффера
+    struct frame_buffer* next_free;         // следующий свободный буффер в списке
+} frame_buffer_typedef;
+
+// функция получения буффера из пула (владелец один; NULL - свободных буфферов нет)
+frame_buffer_typedef* FrameAlloc(void);
+
+// функция добавления владельца буффера (возвращает тот же буффер)
+frame_buffer_typedef* FrameRetain(frame_buffer_typedef* frame);
+
+// функция отказа от владения буффером (последний владелец возвращает буффер в пул)
+void FrameRelease(frame_buffer_typedef* frame);
+
+// функция проверки, есть ли у буффера другие владельцы
+bool FrameShared(frame_buffer_typedef* frame);
+
+// функция получения количества свободных буфферов пула
+uint32_t FramePoolAvailable(void);
+
+#endif
@@ -0,0 +1,59 @@
+#include "rto.h"
+
+#define RTO_INITIAL_US      ((uint64_t)MASTER_WAIT_REPLY_MS * 1000u)        // таймаут до первого измерения
+
+// ограничение таймаута пределами из user.h
+static uint64_t RtoClamp(uint64_t timeout)
+{
+    if(timeout < MASTER_RTO_MIN_US)
+        return MASTER_RTO_MIN_US;
+    if(timeout > MASTER_RTO_MAX_US)
+        return MASTER_RTO_MAX_US;
+    return timeout;
+}
+
+// функция учета измеренного времени ответа (после таймаута измерение пропускается)
+void RTO_Sample(rto_typedef* rto, uint64_t rtt_us)
+{
+    if(rto->retry)
+    {
+        rto->retry = false;
+        return;
+    }
+
+    if(!rto->measured)
+    {
+        // первое измерение: SRTT = RTT, RTTVAR = RTT/2
+        rto->srtt8 = rtt_us << 3;
+        rto->rttvar4 = rtt_us << 1;
+        rto->measured = true;
+    }
+    else
+    {
+        // масштабированные SRTT и RTTVAR: коэффициенты 1/8 и 1/4 без потери дробной части
+        int64_t error = (int64_t)rtt_us - (int64_t)(rto->srtt8 >> 3);
+
+        rto->srtt8 = (uint64_t)((int64_t)rto->srtt8 + error);
+        if(error < 0)
+            error = -error;
+        rto->rttvar4 = (uint64_t)((int64_t)rto->rttvar4 + error - (int64_t)(rto->rttvar4 >> 2));
+    }
+
+    // RTO = SRTT + 4*RTTVAR (не меньше шага часов 1 мкс)
+    rto->rto = RtoClamp((rto->srtt8 >> 3) + ((rto->rttvar4 > 0) ? rto->rttvar4 : 1));
+    rto->backoff = 0;
+}
+
+// функция удвоения таймаута после его истечения
+void RTO_Backoff(rto_typedef* rto)
+{
+    rto->rto = RtoClamp(RTO_Timeout(rto) * 2);
+    rto->backoff++;
+    rto->retry = true;
+}
+
+// функция получения текущего таймаута, мкс
+uint64_t RTO_Timeout(const rto_typedef* rto)
+{
+    return (rto->rto != 0) ? rto->rto : RtoClamp(RTO_INITIAL_US);
+}
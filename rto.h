@@ -0,0 +1,38 @@
+#ifndef RTO_H
+#define RTO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "user.h"
+
+// таймаут повторной передачи по измеренному времени ответа (RTT), как в TCP (RFC 6298):
+// SRTT += (RTT - SRTT)/8, RTTVAR += (|RTT - SRTT| - RTTVAR)/4, RTO = SRTT + 4*RTTVAR в пределах [MASTER_RTO_MIN_US, MASTER_RTO_MAX_US]
+// до первого измерения RTO = MASTER_WAIT_REPLY_MS, каждый таймаут удваивает RTO до следующего измерения
+// алгоритм Карна: первый ответ после таймаута не измеряется - он может относиться к любой из передач кадра
+
+typedef struct                                  // оценка RTT одного ведомого (нулевая инициализация - измерений не было)
+{
+    uint64_t srtt8;                             // сглаженное RTT, мкс * 8
+    uint64_t rttvar4;                           // сглаженное отклонение RTT, мкс * 4
+    uint64_t rto;                               // текущий таймаут с учетом удвоений, мкс (0 - начальный)
+    uint32_t backoff;                           // удвоений после последнего измерения
+    bool measured;                              // было хотя бы одно измерение
+    bool retry;                                 // был таймаут: следующий ответ не измеряется
+} rto_typedef;
+
+// функция учета измеренного времени ответа (после таймаута измерение пропускается)
+void RTO_Sample(rto_typedef* rto, uint64_t rtt_us);
+
+// функция удвоения таймаута после его истечения
+void RTO_Backoff(rto_typedef* rto);
+
+// функция получения текущего таймаута, мкс
+uint64_t RTO_Timeout(const rto_typedef* rto);
+
+// функция получения сглаженного RTT, мкс (0 - измерений не было или RTT меньше 1 мкс)
+static inline uint64_t RTO_SmoothedRtt(const rto_typedef* rto)
+{
+    return rto->srtt8 >> 3;
+}
+
+#endif
@@ -0,0 +1,294 @@
+#include "simd.h"
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+#define SIMD_FLAG_BYTE          0x7E                    // флаг FD HDLC
+#define SIMD_ESCAPE_BYTE        0x7D                    // ESCAPE HDLC
+
+typedef void (*simd_kernel_typedef)(uint8_t* dst, const uint8_t* src, size_t length);
+typedef size_t (*simd_scan_typedef)(const uint8_t* data, size_t length);
+
+static void InvertResolve(uint8_t* dst, const uint8_t* src, size_t length);
+static void MirrorResolve(uint8_t* dst, const uint8_t* src, size_t length);
+static size_t ScanResolve(const uint8_t* data, size_t length);
+
+static simd_kernel_typedef invert_kernel = InvertResolve;     // выбранная реализация инверсии
+static simd_kernel_typedef mirror_kernel = MirrorResolve;     // выбранная реализация отражения
+static simd_scan_typedef scan_kernel = ScanResolve;           // выбранная реализация поиска 0x7E/0x7D
+static const char* kernel_name = "scalar";                    // имя выбранной реализации
+
+/*-----------------------------------------------------SCALAR-------------------------------------------------------------------------------------------------*/
+
+// инверсия байт словами по 8 байт
+static void InvertScalar(uint8_t* dst, const uint8_t* src, size_t length)
+{
+    size_t i = 0;
+    uint64_t word;
+
+    for(; i + 8 <= length; i += 8)
+    {
+        memcpy(&word, &src[i], 8);
+        word = ~word;
+        memcpy(&dst[i], &word, 8);
+    }
+    for(; i < length; i++)
+    {
+        dst[i] = (uint8_t)~src[i];
+    }
+}
+
+// отражение байт: обмен пар с двух концов (подходит и для dst == src)
+static void MirrorScalar(uint8_t* dst, const uint8_t* src, size_t length)
+{
+    size_t lo = 0;
+    size_t hi = length;
+
+    while(hi - lo >= 2)
+    {
+        uint8_t head = src[lo];
+        uint8_t tail = src[hi - 1];
+        dst[lo] = tail;
+        dst[hi - 1] = head;
+        lo++;
+        hi--;
+    }
+    if(hi > lo)
+    {
+        dst[lo] = src[lo];
+    }
+}
+
+// поиск 0x7E/0x7D словами по 8 байт (признак нулевого байта в слове)
+static size_t ScanScalar(const uint8_t* data, size_t length)
+{
+    const uint64_t ones = 0x0101010101010101ULL;
+    const uint64_t highs = 0x8080808080808080ULL;
+    size_t i = 0;
+    uint64_t word;
+
+    for(; i + 8 <= length; i += 8)
+    {
+        memcpy(&word, &data[i], 8);
+        uint64_t flag = word ^ (ones * SIMD_FLAG_BYTE);
+        uint64_t escape = word ^ (ones * SIMD_ESCAPE_BYTE);
+        if((((flag - ones) & ~flag) | ((escape - ones) & ~escape)) & highs)
+            break;                                              // точное место найдет побайтовый цикл
+    }
+    for(; i < length; i++)
+    {
+        if(data[i] == SIMD_FLAG_BYTE || data[i] == SIMD_ESCAPE_BYTE)
+            return i;
+    }
+    return length;
+}
+
+#ifdef SIMD_X86
+/*-----------------------------------------------------SSE2---------------------------------------------------------------------------------------------------*/
+
+__attribute__((target("sse2")))
+static void InvertSse2(uint8_t* dst, const uint8_t* src, size_t length)
+{
+    const __m128i ones = _mm_set1_epi8((char)0xFF);
+    size_t i = 0;
+
+    for(; i + 16 <= length; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)&src[i]);
+        _mm_storeu_si128((__m128i*)&dst[i], _mm_xor_si128(v, ones));
+    }
+    InvertScalar(&dst[i], &src[i], length - i);
+}
+
+// разворот 16 байт средствами SSE2 (без pshufb)
+__attribute__((target("sse2")))
+static inline __m128i ReverseSse2(__m128i v)
+{
+    v = _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3));                  // разворот 32-битных слов
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));                // обмен 16-битных половин
+    v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+    return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));    // обмен байт в 16-битных словах
+}
+
+__attribute__((target("sse2")))
+static void MirrorSse2(uint8_t* dst, const uint8_t* src, size_t length)
+{
+    size_t lo = 0;
+    size_t hi = length;
+
+    // оба блока читаются до записи, поэтому допустимо dst == src
+    while(hi - lo >= 32)
+    {
+        __m128i head = _mm_loadu_si128((const __m128i*)&src[lo]);
+        __m128i tail = _mm_loadu_si128((const __m128i*)&src[hi - 16]);
+        _mm_storeu_si128((__m128i*)&dst[lo], ReverseSse2(tail));
+        _mm_storeu_si128((__m128i*)&dst[hi - 16], ReverseSse2(head));
+        lo += 16;
+        hi -= 16;
+    }
+    MirrorScalar(&dst[lo], &src[lo], hi - lo);
+}
+
+__attribute__((target("sse2")))
+static size_t ScanSse2(const uint8_t* data, size_t length)
+{
+    const __m128i flag = _mm_set1_epi8((char)SIMD_FLAG_BYTE);
+    const __m128i escape = _mm_set1_epi8((char)SIMD_ESCAPE_BYTE);
+    size_t i = 0;
+
+    for(; i + 16 <= length; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)&data[i]);
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, flag), _mm_cmpeq_epi8(v, escape)));
+        if(mask)
+            return i + (size_t)__builtin_ctz((unsigned)mask);
+    }
+    return i + ScanScalar(&data[i], length - i);
+}
+
+/*-----------------------------------------------------AVX2---------------------------------------------------------------------------------------------------*/
+
+__attribute__((target("avx2")))
+static void InvertAvx2(uint8_t* dst, const uint8_t* src, size_t length)
+{
+    const __m256i ones = _mm256_set1_epi8((char)0xFF);
+    size_t i = 0;
+
+    for(; i + 32 <= length; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)&src[i]);
+        _mm256_storeu_si256((__m256i*)&dst[i], _mm256_xor_si256(v, ones));
+    }
+    _mm256_zeroupper();
+    InvertSse2(&dst[i], &src[i], length - i);
+}
+
+// разворот 32 байт: pshufb внутри 128-битных половин и обмен половин
+__attribute__((target("avx2")))
+static inline __m256i ReverseAvx2(__m256i v)
+{
+    const __m256i mask = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+                                          15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    v = _mm256_shuffle_epi8(v, mask);
+    return _mm256_permute4x64_epi64(v, _MM_SHUFFLE(1, 0, 3, 2));
+}
+
+__attribute__((target("avx2")))
+static void MirrorAvx2(uint8_t* dst, const uint8_t* src, size_t length)
+{
+    size_t lo = 0;
+    size_t hi = length;
+
+    while(hi - lo >= 64)
+    {
+        __m256i head = _mm256_loadu_si256((const __m256i*)&src[lo]);
+        __m256i tail = _mm256_loadu_si256((const __m256i*)&src[hi - 32]);
+        _mm256_storeu_si256((__m256i*)&dst[lo], ReverseAvx2(tail));
+        _mm256_storeu_si256((__m256i*)&dst[hi - 32], ReverseAvx2(head));
+        lo += 32;
+        hi -= 32;
+    }
+    _mm256_zeroupper();
+    MirrorSse2(&dst[lo], &src[lo], hi - lo);
+}
+
+__attribute__((target("avx2")))
+static size_t ScanAvx2(const uint8_t* data, size_t length)
+{
+    const __m256i flag = _mm256_set1_epi8((char)SIMD_FLAG_BYTE);
+    const __m256i escape = _mm256_set1_epi8((char)SIMD_ESCAPE_BYTE);
+    size_t i = 0;
+
+    for(; i + 32 <= length; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)&data[i]);
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, flag), _mm256_cmpeq_epi8(v, escape)));
+        if(mask)
+            return i + (size_t)__builtin_ctz(mask);
+    }
+    _mm256_zeroupper();                             // хвост в SSE2 без штрафа перехода AVX->SSE
+    return i + ScanSse2(&data[i], length - i);
+}
+#endif
+
+/*-----------------------------------------------------DISPATCH-----------------------------------------------------------------------------------------------*/
+
+// инициализация: выбор реализаций по возможностям процессора
+void SIMD_Init(void)
+{
+    simd_kernel_typedef invert = InvertScalar;
+    simd_kernel_typedef mirror = MirrorScalar;
+    simd_scan_typedef scan = ScanScalar;
+    const char* name = "scalar";
+
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+    {
+        invert = InvertAvx2;
+        mirror = MirrorAvx2;
+        scan = ScanAvx2;
+        name = "avx2";
+    }
+    else if(__builtin_cpu_supports("sse2"))
+    {
+        invert = InvertSse2;
+        mirror = MirrorSse2;
+        scan = ScanSse2;
+        name = "sse2";
+    }
+#endif
+
+    invert_kernel = invert;
+    mirror_kernel = mirror;
+    scan_kernel = scan;
+    kernel_name = name;
+}
+
+// имя выбранной реализации
+const char* SIMD_KernelName(void)
+{
+    if(invert_kernel == InvertResolve)
+        SIMD_Init();
+    return kernel_name;
+}
+
+// первый вызов выбирает реализацию и передает ей управление
+static void InvertResolve(uint8_t* dst, const uint8_t* src, size_t length)
+{
+    SIMD_Init();
+    invert_kernel(dst, src, length);
+}
+
+static void MirrorResolve(uint8_t* dst, const uint8_t* src, size_t length)
+{
+    SIMD_Init();
+    mirror_kernel(dst, src, length);
+}
+
+static size_t ScanResolve(const uint8_t* data, size_t length)
+{
+    SIMD_Init();
+    return scan_kernel(data, length);
+}
+
+// инверсия байт: dst[i] = ~src[i]
+void SIMD_InvertBytes(uint8_t* dst, const uint8_t* src, size_t length)
+{
+    invert_kernel(dst, src, length);
+}
+
+// отражение байт: dst[i] = src[length-1-i]
+void SIMD_MirrorBytes(uint8_t* dst, const uint8_t* src, size_t length)
+{
+    mirror_kernel(dst, src, length);
+}
+
+// поиск первого байта, требующего байтстаффинга HDLC
+size_t SIMD_FindEscapable(const uint8_t* data, size_t length)
+{
+    return scan_kernel(data, length);
+}
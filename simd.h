@@ -0,0 +1,22 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// инициализация: выбор реализаций по возможностям процессора (вызывается автоматически при первом обращении)
+void SIMD_Init(void);
+
+// имя выбранной реализации ("avx2", "sse2" или "scalar")
+const char* SIMD_KernelName(void);
+
+// инверсия байт: dst[i] = ~src[i] (dst может совпадать с src)
+void SIMD_InvertBytes(uint8_t* dst, const uint8_t* src, size_t length);
+
+// отражение байт: dst[i] = src[length-1-i] (dst может совпадать с src, иначе буфферы не должны пересекаться)
+void SIMD_MirrorBytes(uint8_t* dst, const uint8_t* src, size_t length);
+
+// поиск первого байта, требующего байтстаффинга HDLC (0x7E или 0x7D); возвращает его индекс или length
+size_t SIMD_FindEscapable(const uint8_t* data, size_t length);
+
+#endif
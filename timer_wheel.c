@@ -0,0 +1,209 @@
+#include "timer_wheel.h"
+#include <stddef.h>
+
+#define TIMER_LEVEL_OVERFLOW    TIMER_WHEEL_LEVELS                          // таймер в списке переполнения
+#define TIMER_LEVEL_EXPIRED     (TIMER_WHEEL_LEVELS + 1)                    // таймер в списке сработавших
+#define TIMER_WHEEL_SPAN_BITS   (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)     // разрядов времени, покрытых уровнями
+
+// список, в котором находится таймер
+static timer_typedef** TimerList(timer_wheel_typedef* wheel, uint8_t level, uint8_t slot)
+{
+    if(level == TIMER_LEVEL_OVERFLOW)
+        return &wheel->overflow;
+    if(level == TIMER_LEVEL_EXPIRED)
+        return &wheel->expired;
+    return &wheel->slot[level][slot];
+}
+
+// добавление таймера в начало списка
+static void TimerLink(timer_wheel_typedef* wheel, timer_typedef* timer, uint8_t level, uint8_t slot)
+{
+    timer_typedef** list = TimerList(wheel, level, slot);
+
+    timer->level = level;
+    timer->slot = slot;
+    timer->prev = NULL;
+    timer->next = *list;
+    if(*list != NULL)
+        (*list)->prev = timer;
+    *list = timer;
+    if(level < TIMER_WHEEL_LEVELS)
+        wheel->occupied[level] |= (uint64_t)1 << slot;
+}
+
+// исключение таймера из его списка
+static void TimerUnlink(timer_wheel_typedef* wheel, timer_typedef* timer)
+{
+    timer_typedef** list = TimerList(wheel, timer->level, timer->slot);
+
+    if(timer->prev != NULL)
+        timer->prev->next = timer->next;
+    else
+        *list = timer->next;
+    if(timer->next != NULL)
+        timer->next->prev = timer->prev;
+    if(*list == NULL && timer->level < TIMER_WHEEL_LEVELS)
+        wheel->occupied[timer->level] &= ~((uint64_t)1 << timer->slot);
+    timer->next = NULL;
+    timer->prev = NULL;
+}
+
+// размещение таймера по времени срабатывания относительно времени колеса
+static void TimerPlace(timer_wheel_typedef* wheel, timer_typedef* timer)
+{
+    uint64_t difference;
+    uint32_t level;
+
+    // срабатывание в прошлом или сейчас - на ближайшем шаге колеса
+    if(timer->deadline <= wheel->now)
+        timer->deadline = wheel->now + 1;
+
+    difference = timer->deadline ^ wheel->now;                      // не ноль: срабатывание позже времени колеса
+    level = (uint32_t)(63 - __builtin_clzll(difference)) / TIMER_WHEEL_BITS;
+
+    if(level >= TIMER_WHEEL_LEVELS)
+        TimerLink(wheel, timer, TIMER_LEVEL_OVERFLOW, 0);
+    else
+        TimerLink(wheel, timer, (uint8_t)level, (uint8_t)((timer->deadline >> (level * TIMER_WHEEL_BITS)) & TIMER_WHEEL_MASK));
+}
+
+// функция запуска таймера через timeout_us от времени колеса (запущенный таймер перезапускается)
+void TIMER_Start(timer_wheel_typedef* wheel, timer_typedef* timer, uint64_t timeout_us,
+                 timer_callback_typedef callback, void* arg)
+{
+    TIMER_Cancel(wheel, timer);
+
+    timer->deadline = (timeout_us > TIMER_NEVER - wheel->now) ? TIMER_NEVER - 1 : wheel->now + timeout_us;
+    timer->callback = callback;
+    timer->arg = arg;
+    timer->active = true;
+    wheel->count++;
+    TimerPlace(wheel, timer);
+}
+
+// функция отмены таймера (остановленный таймер не изменяется)
+void TIMER_Cancel(timer_wheel_typedef* wheel, timer_typedef* timer)
+{
+    if(!timer->active)
+        return;
+
+    TimerUnlink(wheel, timer);
+    timer->active = false;
+    wheel->count--;
+}
+
+// ближайший момент после времени колеса, когда непустой слот нужно каскадировать или выполнить
+// слоты уровня с номерами не больше текущего разряда времени всегда пусты: срабатывание таймера уровня позже начала его слота
+static uint64_t TimerNextEvent(const timer_wheel_typedef* wheel)
+{
+    uint64_t next = TIMER_NEVER;
+
+    for(uint32_t level = 0; level < TIMER_WHEEL_LEVELS; level++)
+    {
+        uint32_t shift = level * TIMER_WHEEL_BITS;
+        uint32_t digit = (uint32_t)(wheel->now >> shift) & TIMER_WHEEL_MASK;
+        uint64_t later = (digit == TIMER_WHEEL_MASK) ? 0 : wheel->occupied[level] & (~(uint64_t)0 << (digit + 1));
+
+        if(later != 0)
+        {
+            uint64_t block = (wheel->now >> (shift + TIMER_WHEEL_BITS)) << (shift + TIMER_WHEEL_BITS);
+            uint64_t event = block | ((uint64_t)__builtin_ctzll(later) << shift);
+
+            if(event < next)
+                next = event;
+        }
+    }
+
+    // список переполнения перераспределяется при переходе старшего уровня через ноль
+    if(wheel->overflow != NULL)
+    {
+        uint64_t event = ((wheel->now >> TIMER_WHEEL_SPAN_BITS) + 1) << TIMER_WHEEL_SPAN_BITS;
+
+        if(event < next)
+            next = event;
+    }
+    return next;
+}
+
+// перераспределение списка по уровням; наступившие таймеры переносятся в список сработавших
+static void TimerCascade(timer_wheel_typedef* wheel, timer_typedef* list)
+{
+    while(list != NULL)
+    {
+        timer_typedef* timer = list;
+
+        list = timer->next;
+        if(timer->deadline <= wheel->now)
+            TimerLink(wheel, timer, TIMER_LEVEL_EXPIRED, 0);
+        else
+            TimerPlace(wheel, timer);
+    }
+}
+
+// функция продвижения времени колеса до now_us с вызовом обработчиков истекших таймеров
+// возвращает количество сработавших таймеров
+uint32_t TIMER_Advance(timer_wheel_typedef* wheel, uint64_t now_us)
+{
+    uint32_t fired = 0;
+
+    while(1)
+    {
+        uint64_t event = TimerNextEvent(wheel);
+        timer_typedef* list;
+
+        // пустые слоты между событиями пропускаются
+        if(event > now_us)
+            break;
+        wheel->now = event;
+
+        if((event & (((uint64_t)1 << TIMER_WHEEL_SPAN_BITS) - 1)) == 0 && wheel->overflow != NULL)
+        {
+            list = wheel->overflow;
+            wheel->overflow = NULL;
+            TimerCascade(wheel, list);
+        }
+
+        // каскад сверху вниз: слот уровня, начало которого наступило, переходит на нижние уровни
+        for(uint32_t level = TIMER_WHEEL_LEVELS - 1; level > 0; level--)
+        {
+            uint32_t shift = level * TIMER_WHEEL_BITS;
+            uint32_t digit = (uint32_t)(event >> shift) & TIMER_WHEEL_MASK;
+
+            if((event & (((uint64_t)1 << shift) - 1)) != 0 || wheel->slot[level][digit] == NULL)
+                continue;
+            list = wheel->slot[level][digit];
+            wheel->slot[level][digit] = NULL;
+            wheel->occupied[level] &= ~((uint64_t)1 << digit);
+            TimerCascade(wheel, list);
+        }
+
+        // слот нижнего уровня: срабатывание ровно в текущий момент
+        list = wheel->slot[0][event & TIMER_WHEEL_MASK];
+        wheel->slot[0][event & TIMER_WHEEL_MASK] = NULL;
+        wheel->occupied[0] &= ~((uint64_t)1 << (event & TIMER_WHEEL_MASK));
+        TimerCascade(wheel, list);
+
+        // обработчики вызываются по одному: обработчик может отменить еще не вызванный таймер
+        while(wheel->expired != NULL)
+        {
+            timer_typedef* timer = wheel->expired;
+
+            TimerUnlink(wheel, timer);
+            timer->active = false;
+            wheel->count--;
+            fired++;
+            timer->callback(timer, timer->arg);
+        }
+    }
+
+    if(now_us > wheel->now)
+        wheel->now = now_us;
+    return fired;
+}
+
+// функция получения времени следующего события колеса (TIMER_NEVER - таймеров нет)
+// событие наступает не позже ближайшего срабатывания: до него колесо можно не продвигать
+uint64_t TIMER_NextDeadline(const timer_wheel_typedef* wheel)
+{
+    return TimerNextEvent(wheel);
+}
@@ -0,0 +1,67 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// иерархическое колесо таймеров: 6 уровней по 64 слота с разрешением 1 мкс
+// уровень L охватывает 64^(L+1) мкс; таймер кладется на уровень старшего различающегося с текущим временем разряда
+// и при наступлении начала своего слота перекладывается (каскадируется) на нижний уровень
+// добавление и отмена - O(1), поиск ближайшего события - по битовым картам занятых слотов без перебора таймеров
+// колесо не потокобезопасно: все вызовы выполняет поток-владелец (ведущий)
+
+#define TIMER_WHEEL_BITS        6                                   // разрядов времени на уровень
+#define TIMER_WHEEL_SLOTS       (1u << TIMER_WHEEL_BITS)            // слотов на уровне (по биту карты занятости)
+#define TIMER_WHEEL_MASK        (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_LEVELS      6                                   // уровней (2^36 мкс, около 19 часов; дальше - список переполнения)
+#define TIMER_NEVER             UINT64_MAX                          // нет запущенных таймеров
+
+typedef struct timer timer_typedef;
+
+// обработчик срабатывания (может запускать и отменять любые таймеры, в том числе этот)
+typedef void (*timer_callback_typedef)(timer_typedef* timer, void* arg);
+
+struct timer                                    // таймер (память выделяет владелец, колесо только связывает таймеры в списки)
+{
+    struct timer* next;                         // следующий таймер слота
+    struct timer* prev;                         // предыдущий таймер слота (NULL - первый)
+    uint64_t deadline;                          // время срабатывания, мкс
+    timer_callback_typedef callback;            // обработчик срабатывания
+    void* arg;                                  // аргумент обработчика
+    uint8_t level;                              // уровень колеса (за последним уровнем - список переполнения или сработавших)
+    uint8_t slot;                               // слот на уровне
+    bool active;                                // таймер запущен
+};
+
+typedef struct                                  // колесо таймеров (нулевая инициализация - пустое колесо на времени 0)
+{
+    timer_typedef* slot[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];     // списки таймеров слотов
+    uint64_t occupied[TIMER_WHEEL_LEVELS];      // карты непустых слотов
+    timer_typedef* overflow;                    // таймеры дальше последнего уровня
+    timer_typedef* expired;                     // сработавшие таймеры, ожидающие вызова обработчика
+    uint64_t now;                               // время колеса, мкс (изменяется только TIMER_Advance)
+    uint32_t count;                             // количество запущенных таймеров
+} timer_wheel_typedef;
+
+// функция запуска таймера через timeout_us от времени колеса (запущенный таймер перезапускается)
+void TIMER_Start(timer_wheel_typedef* wheel, timer_typedef* timer, uint64_t timeout_us,
+                 timer_callback_typedef callback, void* arg);
+
+// функция отмены таймера (остановленный таймер не изменяется)
+void TIMER_Cancel(timer_wheel_typedef* wheel, timer_typedef* timer);
+
+// функция продвижения времени колеса до now_us с вызовом обработчиков истекших таймеров
+// возвращает количество сработавших таймеров
+uint32_t TIMER_Advance(timer_wheel_typedef* wheel, uint64_t now_us);
+
+// функция получения времени следующего события колеса (TIMER_NEVER - таймеров нет)
+// событие наступает не позже ближайшего срабатывания: до него колесо можно не продвигать
+uint64_t TIMER_NextDeadline(const timer_wheel_typedef* wheel);
+
+// проверка, запущен ли таймер
+static inline bool TIMER_IsActive(const timer_typedef* timer)
+{
+    return timer->active;
+}
+
+#endif
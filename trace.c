@@ -0,0 +1,201 @@
+#include "trace.h"
+#include "hdlc.h"
+#include "timer.h"
+#include <stdlib.h>
+#include <string.h>
+
+_Atomic uint8_t trace_level = TRACE_LEVEL_INFO;                 // текущий уровень журнала
+
+// описание событий: уровень и формат сообщения
+const trace_event_info_typedef trace_events[TRACE_EVENT_COUNT] =
+{
+    [TRACE_RX_BYTE]                     = {TRACE_LEVEL_BYTE,  "Received:\t%02X"},
+    [TRACE_RX_FRAME_START]              = {TRACE_LEVEL_DEBUG, "FD received - start of frame"},
+    [TRACE_RX_ADDRESS]                  = {TRACE_LEVEL_DEBUG, "Address received"},
+    [TRACE_RX_SKIP]                     = {TRACE_LEVEL_DEBUG, "Frame for unit 0x%02X, skipping"},
+    [TRACE_RX_COMMAND]                  = {TRACE_LEVEL_DEBUG, "Command received"},
+    [TRACE_RX_FRAME_END]                = {TRACE_LEVEL_DEBUG, "FD received - end of frame (%u bytes)"},
+    [TRACE_RX_FRAME_OK]                 = {TRACE_LEVEL_INFO,  "Frame validated successfully! (%u bytes of information)"},
+    [TRACE_RX_FRAME_FAILED]             = {TRACE_LEVEL_ERROR, "Frame validation failed!"},
+    [TRACE_RX_TOO_LONG]                 = {TRACE_LEVEL_ERROR, "Frame too long, resynchronizing..."},
+    [TRACE_RX_NO_BUFFER]                = {TRACE_LEVEL_ERROR, "No free frame buffer, skipping frame"},
+    [TRACE_RX_WRONG_SIZE]               = {TRACE_LEVEL_ERROR, "Wrong frame size: %u bytes (header and FCS: %u bytes)"},
+    [TRACE_RX_NOT_ASSEMBLED]            = {TRACE_LEVEL_ERROR, "Frame not assembled"},
+    [TRACE_RX_WRONG_ADDRESS]            = {TRACE_LEVEL_ERROR, "Invalid destination address (received: 0x%02X, expected: 0x%02X)"},
+    [TRACE_RX_UNKNOWN_COMMAND]          = {TRACE_LEVEL_ERROR, "Unknown command: 0x%02X"},
+    [TRACE_RX_COMMAND_SIZE]             = {TRACE_LEVEL_ERROR, "Information field too long for command 0x%02X: %u bytes"},
+    [TRACE_RX_BAD_FCS]                  = {TRACE_LEVEL_ERROR, "Invalid FCS (received: 0x%04X, calculated: 0x%04X)"},
+    [TRACE_RX_PAYLOAD]                  = {TRACE_LEVEL_INFO,  "Received information:\t\t%u bytes [%08X ...]"},
+
+    [TRACE_TX_BYTE]                     = {TRACE_LEVEL_BYTE,  "Transmitted to unit 0x%02X:\t%02X"},
+    [TRACE_TX_START]                    = {TRACE_LEVEL_DEBUG, "Start transmitting..."},
+    [TRACE_TX_DONE]                     = {TRACE_LEVEL_INFO,  "Frame sent completely!"},
+    [TRACE_TX_PAYLOAD]                  = {TRACE_LEVEL_INFO,  "Transmitted information:\t%u bytes [%08X ...]"},
+
+    [TRACE_FIFO_FULL]                   = {TRACE_LEVEL_DEBUG, "FIFO is full, waiting..."},
+    [TRACE_FIFO_EMPTY]                  = {TRACE_LEVEL_DEBUG, "FIFO is empty, waiting..."},
+    [TRACE_FIFO_MTS_STATE]              = {TRACE_LEVEL_BYTE,  "MTS FIFO: read %u, write %u"},
+    [TRACE_FIFO_STM_STATE]              = {TRACE_LEVEL_BYTE,  "STM FIFO: read %u, write %u"},
+
+    [TRACE_MASTER_PREPARE]              = {TRACE_LEVEL_INFO,  "Preparing message with command: 0x%02X to unit: 0x%02X"},
+    [TRACE_MASTER_PREPARE_SEQUENCED]    = {TRACE_LEVEL_INFO,  "Preparing message to unit: 0x%02X, N(S)=%u"},
+    [TRACE_MASTER_RESEND]               = {TRACE_LEVEL_ERROR, "Resending N(S)=%u to unit: 0x%02X"},
+    [TRACE_MASTER_WAIT_REPLY]           = {TRACE_LEVEL_DEBUG, "Waiting for reply from unit 0x%02X..."},
+    [TRACE_MASTER_NO_REPLY]             = {TRACE_LEVEL_ERROR, "No reply received. Sending again..."},
+    [TRACE_MASTER_WAIT_ACK]             = {TRACE_LEVEL_DEBUG, "Waiting for acknowledgement from unit 0x%02X (%u frames outstanding)..."},
+    [TRACE_MASTER_ACK]                  = {TRACE_LEVEL_INFO,  "Frames acknowledged up to N(R)=%u"},
+    [TRACE_MASTER_ACK_TIMEOUT]          = {TRACE_LEVEL_ERROR, "No acknowledgement received. Resending from N(S)=%u..."},
+    [TRACE_MASTER_REJ]                  = {TRACE_LEVEL_ERROR, "REJ received, resending from N(S)=%u"},
+    [TRACE_MASTER_REJ_LIMIT]            = {TRACE_LEVEL_ERROR, "REJ ignored after %u resends, waiting for timeout"},
+    [TRACE_MASTER_COMMAND_ERROR]        = {TRACE_LEVEL_ERROR, "Slave could not execute command 0x%02X (status %u)"},
+    [TRACE_MASTER_BATCH_RESULT]         = {TRACE_LEVEL_INFO,  "Batch result: command 0x%02X, status %u"},
+    [TRACE_MASTER_BATCH_MALFORMED]      = {TRACE_LEVEL_ERROR, "Batch reply malformed at offset %u of %u"},
+    [TRACE_MASTER_BAD_NR]               = {TRACE_LEVEL_ERROR, "Invalid N(R)=%u (V(S)=%u), ignoring"},
+    [TRACE_MASTER_REPLY_LOST]           = {TRACE_LEVEL_ERROR, "Reply N(S)=%u, expected %u: reply lost"},
+    [TRACE_MASTER_RTT]                  = {TRACE_LEVEL_DEBUG, "Smoothed RTT %u us, retransmission timeout %u us"},
+
+    [TRACE_SLAVE_COMMAND]               = {TRACE_LEVEL_INFO,  "Processing command 0x%02X"},
+    [TRACE_SLAVE_UNKNOWN_COMMAND]       = {TRACE_LEVEL_ERROR, "Unknown command 0x%02X"},
+    [TRACE_SLAVE_BROADCAST]             = {TRACE_LEVEL_INFO,  "Broadcast command executed, no reply"},
+    [TRACE_SLAVE_OUT_OF_SEQUENCE]       = {TRACE_LEVEL_ERROR, "N(S)=%u out of sequence (expected %u)"},
+    [TRACE_SLAVE_REJECT]                = {TRACE_LEVEL_ERROR, "Frame discarded (error %u), sending REJ N(R)=%u"},
+    [TRACE_SLAVE_REPLY]                 = {TRACE_LEVEL_DEBUG, "Preparing reply to master..."},
+    [TRACE_SLAVE_WAIT]                  = {TRACE_LEVEL_DEBUG, "Waiting for next message..."},
+};
+
+static trace_ring_typedef trace_rings[TRACE_MAX_THREADS];      // буфферы потоков
+static _Atomic uint32_t trace_ring_count = 0;                   // занятых буфферов
+static _Thread_local trace_ring_typedef* trace_ring_local;      // буффер текущего потока
+static _Thread_local bool trace_ring_failed;                    // буфферов для текущего потока не хватило
+static uint64_t trace_start_time;                               // время TRACE_Init (начало отсчета при выгрузке)
+
+// функция установки уровня журнала из переменной окружения HDLC_TRACE_LEVEL (по умолчанию TRACE_LEVEL_INFO)
+void TRACE_Init(void)
+{
+    static const char* const names[] = {"off", "error", "info", "debug", "byte"};
+    const char* value = getenv("HDLC_TRACE_LEVEL");
+
+    trace_start_time = GetCurrentTimeNs();
+    if(value == NULL)   return;
+
+    for(int level = TRACE_LEVEL_OFF; level <= TRACE_LEVEL_BYTE; level++)
+    {
+        if(strcmp(value, names[level]) == 0 || (value[0] == '0' + level && value[1] == '\0'))
+        {
+            TRACE_SetLevel((trace_level_typedef)level);
+            return;
+        }
+    }
+    fprintf(stderr, "Unknown HDLC_TRACE_LEVEL \"%s\", using \"%s\"\n", value, names[atomic_load(&trace_level)]);
+}
+
+// функция установки уровня журнала
+void TRACE_SetLevel(trace_level_typedef level)
+{
+    atomic_store_explicit(&trace_level, (uint8_t)level, memory_order_relaxed);
+}
+
+// получение буффера текущего потока (при первой записи буффер закрепляется за потоком)
+static trace_ring_typedef* TRACE_LocalRing(void)
+{
+    if(trace_ring_local == NULL && !trace_ring_failed)
+    {
+        uint32_t index = atomic_fetch_add_explicit(&trace_ring_count, 1, memory_order_acq_rel);
+
+        if(index < TRACE_MAX_THREADS)
+            trace_ring_local = &trace_rings[index];
+        else
+            trace_ring_failed = true;
+    }
+    return trace_ring_local;
+}
+
+// функция записи события в буффер текущего потока (при переполнении запись отбрасывается)
+void TRACE_Write(trace_event_typedef event, uint8_t link, uint32_t arg0, uint32_t arg1)
+{
+    trace_ring_typedef* ring = TRACE_LocalRing();
+
+    if(ring == NULL)    return;
+
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    if(head - tail >= TRACE_RING_SIZE)
+    {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    trace_record_typedef* record = &ring->record[head & (TRACE_RING_SIZE - 1)];
+    record->timestamp = GetCurrentTimeNs();
+    record->event = (uint16_t)event;
+    record->link = link;
+    record->arg0 = arg0;
+    record->arg1 = arg1;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+// имя узла для выгрузки
+static const char* TRACE_LinkName(uint8_t link, char* buffer, size_t size)
+{
+    if(link == HDLC_MASTER_ADDR)            return "Master";
+    if(link == HDLC_BROADCAST_ADDR)         return "Broadcast";
+    if(link == TRACE_LINK_BUS)              return "Bus";
+    snprintf(buffer, size, "Slave %02X", link);
+    return buffer;
+}
+
+// функция выгрузки накопленных записей всех потоков в порядке времени (возвращает количество записей)
+uint32_t TRACE_Drain(FILE* out)
+{
+    uint32_t count = atomic_load_explicit(&trace_ring_count, memory_order_acquire);
+    uint32_t head[TRACE_MAX_THREADS];           // границы выгрузки, зафиксированные в начале
+    uint32_t tail[TRACE_MAX_THREADS];
+    uint32_t drained = 0;
+    char name[16];
+
+    if(count > TRACE_MAX_THREADS)
+        count = TRACE_MAX_THREADS;
+
+    for(uint32_t i = 0; i < count; i++)
+    {
+        uint32_t dropped = atomic_exchange_explicit(&trace_rings[i].dropped, 0, memory_order_relaxed);
+
+        head[i] = atomic_load_explicit(&trace_rings[i].head, memory_order_acquire);
+        tail[i] = atomic_load_explicit(&trace_rings[i].tail, memory_order_relaxed);
+        if(dropped != 0)
+            fprintf(out, "Trace:\t%u records dropped (thread %u)\n", dropped, i);
+    }
+
+    // слияние буфферов: каждый раз выводится самая ранняя из первых записей
+    while(1)
+    {
+        int earliest = -1;
+
+        for(uint32_t i = 0; i < count; i++)
+        {
+            if(tail[i] == head[i])  continue;
+            if(earliest < 0 || trace_rings[i].record[tail[i] & (TRACE_RING_SIZE - 1)].timestamp <
+                               trace_rings[earliest].record[tail[earliest] & (TRACE_RING_SIZE - 1)].timestamp)
+                earliest = (int)i;
+        }
+        if(earliest < 0)    break;
+
+        trace_ring_typedef* ring = &trace_rings[earliest];
+        const trace_record_typedef* record = &ring->record[tail[earliest] & (TRACE_RING_SIZE - 1)];
+        uint64_t time = record->timestamp - trace_start_time;
+
+        if(record->event < TRACE_EVENT_COUNT)
+        {
+            fprintf(out, "[%4u.%06u] %s:\t", (unsigned)(time / 1000000000u), (unsigned)((time / 1000u) % 1000000u),
+                    TRACE_LinkName(record->link, name, sizeof(name)));
+            fprintf(out, trace_events[record->event].format, record->arg0, record->arg1);
+            fputc('\n', out);
+        }
+
+        tail[earliest]++;
+        atomic_store_explicit(&ring->tail, tail[earliest], memory_order_release);
+        drained++;
+    }
+    return drained;
+}
@@ -0,0 +1,151 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+// журнал событий: каждое событие - запись фиксированного размера в кольцевой буффер своего потока,
+// форматирование выполняется позже, при выгрузке (TRACE_Drain)
+// уровень задается при запуске переменной окружения HDLC_TRACE_LEVEL (0..4 или off/error/info/debug/byte)
+
+#define TRACE_RING_SIZE         4096        // записей в буффере одного потока (степень двойки)
+#define TRACE_MAX_THREADS       8           // количество потоков, пишущих в журнал
+#define TRACE_CACHE_LINE        64          // размер кэш-линии (индексы писателя и читателя на разных линиях)
+
+#if (TRACE_RING_SIZE & (TRACE_RING_SIZE - 1)) != 0
+#error "TRACE_RING_SIZE должен быть степенью двойки"
+#endif
+
+#define TRACE_LINK_BUS          0x00        // номер канала для событий шины (FIFO)
+
+typedef enum                                // уровни подробности журнала
+{
+    TRACE_LEVEL_OFF = 0,                    // журнал выключен
+    TRACE_LEVEL_ERROR,                      // ошибки приёма и повторы
+    TRACE_LEVEL_INFO,                       // отправленные и принятые кадры, подтверждения
+    TRACE_LEVEL_DEBUG,                      // поля кадра, ожидание и состояние автоматов
+    TRACE_LEVEL_BYTE                        // каждый байт и состояние FIFO
+} trace_level_typedef;
+
+typedef enum                                // события журнала
+{
+    // приём кадра
+    TRACE_RX_BYTE,
+    TRACE_RX_FRAME_START,
+    TRACE_RX_ADDRESS,
+    TRACE_RX_SKIP,
+    TRACE_RX_COMMAND,
+    TRACE_RX_FRAME_END,
+    TRACE_RX_FRAME_OK,
+    TRACE_RX_FRAME_FAILED,
+    TRACE_RX_TOO_LONG,
+    TRACE_RX_NO_BUFFER,
+    TRACE_RX_WRONG_SIZE,
+    TRACE_RX_NOT_ASSEMBLED,
+    TRACE_RX_WRONG_ADDRESS,
+    TRACE_RX_UNKNOWN_COMMAND,
+    TRACE_RX_COMMAND_SIZE,
+    TRACE_RX_BAD_FCS,
+    TRACE_RX_PAYLOAD,
+
+    // передача кадра
+    TRACE_TX_BYTE,
+    TRACE_TX_START,
+    TRACE_TX_DONE,
+    TRACE_TX_PAYLOAD,
+
+    // FIFO
+    TRACE_FIFO_FULL,
+    TRACE_FIFO_EMPTY,
+    TRACE_FIFO_MTS_STATE,
+    TRACE_FIFO_STM_STATE,
+
+    // ведущий
+    TRACE_MASTER_PREPARE,
+    TRACE_MASTER_PREPARE_SEQUENCED,
+    TRACE_MASTER_RESEND,
+    TRACE_MASTER_WAIT_REPLY,
+    TRACE_MASTER_NO_REPLY,
+    TRACE_MASTER_WAIT_ACK,
+    TRACE_MASTER_ACK,
+    TRACE_MASTER_ACK_TIMEOUT,
+    TRACE_MASTER_REJ,
+    TRACE_MASTER_REJ_LIMIT,
+    TRACE_MASTER_COMMAND_ERROR,
+    TRACE_MASTER_BATCH_RESULT,
+    TRACE_MASTER_BATCH_MALFORMED,
+    TRACE_MASTER_BAD_NR,
+    TRACE_MASTER_REPLY_LOST,
+    TRACE_MASTER_RTT,
+
+    // ведомый
+    TRACE_SLAVE_COMMAND,
+    TRACE_SLAVE_UNKNOWN_COMMAND,
+    TRACE_SLAVE_BROADCAST,
+    TRACE_SLAVE_OUT_OF_SEQUENCE,
+    TRACE_SLAVE_REJECT,
+    TRACE_SLAVE_REPLY,
+    TRACE_SLAVE_WAIT,
+
+    TRACE_EVENT_COUNT
+} trace_event_typedef;
+
+typedef struct                              // описание события для фильтрации и выгрузки
+{
+    uint8_t level;                          // уровень, начиная с которого событие записывается
+    const char* format;                     // формат сообщения (аргументы arg0, arg1)
+} trace_event_info_typedef;
+
+typedef struct                              // запись журнала
+{
+    uint64_t timestamp;                     // время события в наносекундах
+    uint16_t event;                         // событие (trace_event_typedef)
+    uint8_t link;                           // адрес узла (TRACE_LINK_BUS - шина)
+    uint32_t arg0;                          // аргументы события
+    uint32_t arg1;
+} trace_record_typedef;
+
+typedef struct                                              // буффер записей одного потока (один писатель, один читатель)
+{
+    trace_record_typedef record[TRACE_RING_SIZE];           // записи
+    _Alignas(TRACE_CACHE_LINE) _Atomic uint32_t head;       // индекс записи (изменяет только поток-владелец)
+    _Alignas(TRACE_CACHE_LINE) _Atomic uint32_t tail;       // индекс чтения (изменяет только TRACE_Drain)
+    _Atomic uint32_t dropped;                               // записей, не поместившихся в буффер
+} trace_ring_typedef;
+
+extern _Atomic uint8_t trace_level;                                     // текущий уровень журнала
+extern const trace_event_info_typedef trace_events[TRACE_EVENT_COUNT];  // описание событий
+
+// запись события (проверка уровня - одно чтение, без вызова функции)
+#define TRACE(event, link, arg0, arg1)                                                                          \
+    do                                                                                                          \
+    {                                                                                                           \
+        if(trace_events[(event)].level <= atomic_load_explicit(&trace_level, memory_order_relaxed))             \
+            TRACE_Write((event), (link), (uint32_t)(arg0), (uint32_t)(arg1));                                   \
+    } while(0)
+
+// функция установки уровня журнала из переменной окружения HDLC_TRACE_LEVEL (по умолчанию TRACE_LEVEL_INFO)
+void TRACE_Init(void);
+
+// функция установки уровня журнала
+void TRACE_SetLevel(trace_level_typedef level);
+
+// функция записи события в буффер текущего потока (при переполнении запись отбрасывается)
+void TRACE_Write(trace_event_typedef event, uint8_t link, uint32_t arg0, uint32_t arg1);
+
+// функция выгрузки накопленных записей всех потоков в порядке времени (возвращает количество записей)
+uint32_t TRACE_Drain(FILE* out);
+
+// упаковка первых четырех байт информационного поля в аргумент события
+static inline uint32_t TRACE_PayloadHead(const uint8_t* data, uint32_t length)
+{
+    uint32_t head = 0;
+
+    for(uint32_t i = 0; i < 4; i++)
+        head = (head << 8) | ((i < length) ? data[i] : 0);
+    return head;
+}
+
+#endif
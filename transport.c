@@ -0,0 +1,376 @@
+#define _GNU_SOURCE                         // posix_openpt, ptsname, cfmakeraw
+#include "transport.h"
+
+#ifdef LINUX
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include "event.h"
+
+#ifdef FIFO_SPSC
+struct transport_shared                             // общая память линии TRANSPORT_SHM
+{
+    fifo_typedef ring[2];                           // ring[i] - кольцо приёма конца i (запись другим концом)
+    event_typedef wake[2];                          // wake[i] - пробуждение конца i (данные в его кольце или место в кольце другого)
+    _Atomic uint32_t closed[2];                     // конец i закрыт
+};
+
+// общая память: memfd отображается до fork и наследуется процессом другого конца
+static bool TransportOpenShared(transport_typedef* first, transport_typedef* second)
+{
+    struct transport_shared* shared;
+    int fd = memfd_create("hdlc_transport", MFD_CLOEXEC);
+
+    if(fd < 0)
+        return false;
+    if(ftruncate(fd, sizeof(struct transport_shared)) != 0)
+    {
+        close(fd);
+        return false;
+    }
+    shared = mmap(NULL, sizeof(struct transport_shared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);                                      // отображение остается и после закрытия memfd
+    if(shared == MAP_FAILED)
+        return false;
+
+    for(int i = 0; i < 2; i++)
+    {
+        FifoInit(&shared->ring[i]);
+        atomic_store(&shared->wake[i].sequence, 0);
+        atomic_store(&shared->wake[i].waiters, 0);
+        atomic_store(&shared->closed[i], 0);
+    }
+    *first = (transport_typedef){.kind=TRANSPORT_SHM, .rx_fd=-1, .tx_fd=-1, .shared=shared, .side=0, .readable=true, .writable=true};
+    *second = (transport_typedef){.kind=TRANSPORT_SHM, .rx_fd=-1, .tx_fd=-1, .shared=shared, .side=1, .readable=true, .writable=true};
+    return true;
+}
+
+// копирование из своего кольца в rx_fifo (без системных вызовов, пока другая сторона не спит)
+static int32_t TransportSharedReceive(transport_typedef* transport)
+{
+    struct transport_shared* shared = transport->shared;
+    fifo_typedef* ring = &shared->ring[transport->side];
+    fifo_span_typedef span;
+    uint32_t length = FifoReadPeek(ring, FifoFreeSpace(transport->rx_fifo), &span);
+
+    if(length == 0)
+    {
+        // данные, записанные до закрытия, принимаются полностью
+        if(atomic_load(&shared->closed[transport->side ^ 1]) && FifoIsEmpty(ring))
+            return TRANSPORT_CLOSED;
+        return 0;
+    }
+    FifoWrite(transport->rx_fifo, span.region[0].data, span.region[0].length);
+    FifoWrite(transport->rx_fifo, span.region[1].data, span.region[1].length);
+    FifoReadConsume(ring, length);
+    EventSignalShared(&shared->wake[transport->side ^ 1]);     // другая сторона могла ждать места в кольце
+    transport->rx_bytes += length;
+    transport->rx_calls++;
+    return (int32_t)length;
+}
+
+// копирование tx_fifo в кольцо другой стороны
+static int32_t TransportSharedSend(transport_typedef* transport)
+{
+    struct transport_shared* shared = transport->shared;
+    fifo_typedef* ring = &shared->ring[transport->side ^ 1];
+    fifo_span_typedef span;
+    uint32_t length;
+
+    if(atomic_load(&shared->closed[transport->side ^ 1]))
+        return TRANSPORT_CLOSED;
+
+    length = FifoReadPeek(transport->tx_fifo, FifoFreeSpace(ring), &span);
+    if(length == 0)
+        return 0;
+    FifoWrite(ring, span.region[0].data, span.region[0].length);
+    FifoWrite(ring, span.region[1].data, span.region[1].length);
+    FifoReadConsume(transport->tx_fifo, length);
+    EventSignalShared(&shared->wake[transport->side ^ 1]);     // другая сторона могла ждать данных
+    transport->tx_bytes += length;
+    transport->tx_calls++;
+    return (int32_t)length;
+}
+#endif
+
+// перевод дескриптора в неблокирующий режим
+static bool TransportNonBlocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL);
+
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// заполнение конца линии
+static void TransportInit(transport_typedef* transport, transport_kind_typedef kind, int rx_fd, int tx_fd)
+{
+    *transport = (transport_typedef){.kind=kind, .rx_fd=rx_fd, .tx_fd=tx_fd, .shared=NULL, .readable=true, .writable=true};
+}
+
+// псевдотерминал: ведущая сторона (ptmx) и подчиненная (pts) без обработки строк, эха и преобразования символов
+static bool TransportOpenPty(int* master_fd, int* slave_fd)
+{
+    struct termios attributes;
+
+    *master_fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if(*master_fd < 0)
+        return false;
+    if(grantpt(*master_fd) != 0 || unlockpt(*master_fd) != 0 ||
+       (*slave_fd = open(ptsname(*master_fd), O_RDWR | O_NOCTTY)) < 0)
+    {
+        close(*master_fd);
+        return false;
+    }
+    if(tcgetattr(*slave_fd, &attributes) == 0)
+    {
+        cfmakeraw(&attributes);
+        if(tcsetattr(*slave_fd, TCSANOW, &attributes) == 0)
+            return true;
+    }
+
+    // без режима raw линия искажает байты кадров: открытие не удалось, errno - причина отказа termios
+    int error = errno;
+
+    close(*master_fd);
+    close(*slave_fd);
+    errno = error;
+    return false;
+}
+
+// функция создания линии и двух ее концов (неблокирующие дескрипторы); false - ошибка (errno)
+bool TRANSPORT_OpenPair(transport_kind_typedef kind, transport_typedef* first, transport_typedef* second)
+{
+    int fd[4];
+
+    switch(kind)
+    {
+        case TRANSPORT_PIPE:
+            // fd[0..1]: first -> second, fd[2..3]: second -> first
+            if(pipe(&fd[0]) != 0)
+                return false;
+            if(pipe(&fd[2]) != 0)
+            {
+                close(fd[0]);
+                close(fd[1]);
+                return false;
+            }
+            TransportInit(first, kind, fd[2], fd[1]);
+            TransportInit(second, kind, fd[0], fd[3]);
+            break;
+
+        case TRANSPORT_SOCKETPAIR:
+            if(socketpair(AF_UNIX, SOCK_STREAM, 0, fd) != 0)
+                return false;
+            TransportInit(first, kind, fd[0], fd[0]);
+            TransportInit(second, kind, fd[1], fd[1]);
+            break;
+
+        case TRANSPORT_PTY:
+            if(!TransportOpenPty(&fd[0], &fd[1]))
+                return false;
+            TransportInit(first, kind, fd[0], fd[0]);
+            TransportInit(second, kind, fd[1], fd[1]);
+            break;
+
+        case TRANSPORT_SHM:
+        #ifdef FIFO_SPSC
+            return TransportOpenShared(first, second);
+        #else
+            errno = ENOTSUP;                        // кольцам в общей памяти нужны атомарные индексы FIFO_SPSC
+            return false;
+        #endif
+
+        default:
+            errno = EINVAL;
+            return false;
+    }
+
+    if(!TransportNonBlocking(first->rx_fd) || !TransportNonBlocking(first->tx_fd) ||
+       !TransportNonBlocking(second->rx_fd) || !TransportNonBlocking(second->tx_fd))
+    {
+        TRANSPORT_Close(first);
+        TRANSPORT_Close(second);
+        return false;
+    }
+    return true;
+}
+
+// функция привязки FIFO приёма и передачи к концу линии
+void TRANSPORT_Attach(transport_typedef* transport, fifo_typedef* rx_fifo, fifo_typedef* tx_fifo)
+{
+    transport->rx_fifo = rx_fifo;
+    transport->tx_fifo = tx_fifo;
+}
+
+// функция закрытия конца линии
+void TRANSPORT_Close(transport_typedef* transport)
+{
+#ifdef FIFO_SPSC
+    if(transport->shared != NULL && transport->rx_fifo != NULL)
+    {
+        atomic_store(&transport->shared->closed[transport->side], 1);
+        EventSignalShared(&transport->shared->wake[transport->side ^ 1]);
+        munmap(transport->shared, sizeof(struct transport_shared));
+    }
+#endif
+    transport->shared = NULL;
+    if(transport->tx_fd >= 0 && transport->tx_fd != transport->rx_fd)
+        close(transport->tx_fd);
+    if(transport->rx_fd >= 0)
+        close(transport->rx_fd);
+    transport->rx_fd = -1;
+    transport->tx_fd = -1;
+}
+
+// перевод участка FIFO в вектор для readv/writev (пустой второй участок не передается)
+static int TransportVector(const fifo_span_typedef* span, struct iovec* vector)
+{
+    vector[0].iov_base = span->region[0].data;
+    vector[0].iov_len = span->region[0].length;
+    vector[1].iov_base = span->region[1].data;
+    vector[1].iov_len = span->region[1].length;
+    return span->region[1].length ? 2 : 1;
+}
+
+// функция чтения из линии в свободное место rx_fifo одним readv
+// возвращает количество принятых байт (0 - данных нет или FIFO полон) или TRANSPORT_CLOSED
+int32_t TRANSPORT_Receive(transport_typedef* transport)
+{
+    fifo_span_typedef span;
+    struct iovec vector[2];
+    ssize_t length;
+
+#ifdef FIFO_SPSC
+    if(transport->shared != NULL)
+        return TransportSharedReceive(transport);
+#endif
+    if(FifoWriteReserve(transport->rx_fifo, FIFO_SIZE, &span) == 0)
+        return 0;
+
+    length = readv(transport->rx_fd, vector, TransportVector(&span, vector));
+    if(length < 0)
+    {
+        if(errno == EAGAIN || errno == EINTR)
+        {
+            transport->readable = (errno == EINTR);
+            return 0;
+        }
+        return TRANSPORT_CLOSED;                    // у PTY закрытие другой стороны - EIO
+    }
+    if(length == 0)
+        return TRANSPORT_CLOSED;
+
+    // неполное чтение - данные в ядре закончились, следующее чтение после EPOLLIN
+    if((uint32_t)length < span.length)
+        transport->readable = false;
+    FifoWriteCommit(transport->rx_fifo, (uint32_t)length);
+    transport->rx_bytes += (uint64_t)length;
+    transport->rx_calls++;
+    return (int32_t)length;
+}
+
+// функция записи данных tx_fifo в линию одним writev
+// возвращает количество отправленных байт (0 - линия занята или FIFO пуст) или TRANSPORT_CLOSED
+int32_t TRANSPORT_Send(transport_typedef* transport)
+{
+    fifo_span_typedef span;
+    struct iovec vector[2];
+    ssize_t length;
+
+#ifdef FIFO_SPSC
+    if(transport->shared != NULL)
+        return TransportSharedSend(transport);
+#endif
+    if(FifoReadPeek(transport->tx_fifo, FIFO_SIZE, &span) == 0)
+        return 0;
+
+    length = writev(transport->tx_fd, vector, TransportVector(&span, vector));
+    if(length < 0)
+    {
+        if(errno == EAGAIN || errno == EINTR)
+        {
+            transport->writable = (errno == EINTR);
+            return 0;
+        }
+        return TRANSPORT_CLOSED;                    // EPIPE: другая сторона закрыла линию
+    }
+
+    // неполная запись - буффер ядра заполнен, следующая запись после EPOLLOUT
+    if((uint32_t)length < span.length)
+        transport->writable = false;
+    FifoReadConsume(transport->tx_fifo, (uint32_t)length);
+    transport->tx_bytes += (uint64_t)length;
+    transport->tx_calls++;
+    return (int32_t)length;
+}
+
+// функция подготовки к ожиданию линии SHM (вызывается до проверки колец, результат передается в TRANSPORT_WaitShared)
+uint32_t TRANSPORT_PrepareWait(transport_typedef* transport)
+{
+#ifdef FIFO_SPSC
+    if(transport->shared != NULL)
+        return EventPrepare(&transport->shared->wake[transport->side]);
+#else
+    (void)transport;
+#endif
+    return 0;
+}
+
+// функция ожидания действия другой стороны линии SHM (timeout_us = 0 - без ограничения)
+// системный вызов выполняется, только если другая сторона ничего не сделала и за время короткого опроса
+void TRANSPORT_WaitShared(transport_typedef* transport, uint32_t sequence, uint32_t timeout_us)
+{
+#ifdef FIFO_SPSC
+    static long processors = 0;
+
+    if(transport->shared == NULL)
+        return;
+    if(processors == 0)
+        processors = sysconf(_SC_NPROCESSORS_ONLN);
+
+    // ответ другой стороны обычно приходит быстрее, чем засыпание и пробуждение на futex
+    // (на одном процессоре опрос только отнимает время у другой стороны)
+    for(uint32_t i = 0; processors > 1 && i < TRANSPORT_SPIN_COUNT; i++)
+    {
+        if(EventPrepare(&transport->shared->wake[transport->side]) != sequence)
+            return;
+    }
+    EventWaitShared(&transport->shared->wake[transport->side], sequence, timeout_us);
+#else
+    (void)transport;
+    (void)sequence;
+    (void)timeout_us;
+#endif
+}
+
+// функция учета готовности дескриптора fd, сообщенной epoll (флаги EPOLLIN, EPOLLOUT, EPOLLHUP, EPOLLERR)
+void TRANSPORT_HandleEvents(transport_typedef* transport, int fd, uint32_t events)
+{
+    // при закрытии и ошибке следующий вызов readv/writev вернет TRANSPORT_CLOSED
+    if(fd == transport->rx_fd && (events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+        transport->readable = true;
+    if(fd == transport->tx_fd && (events & (EPOLLOUT | EPOLLHUP | EPOLLERR)))
+        transport->writable = true;
+}
+
+// имя вида линии ("pipe", "socketpair" или "pty")
+const char* TRANSPORT_KindName(transport_kind_typedef kind)
+{
+    switch(kind)
+    {
+        case TRANSPORT_PIPE:        return "pipe";
+        case TRANSPORT_SOCKETPAIR:  return "socketpair";
+        case TRANSPORT_PTY:         return "pty";
+        case TRANSPORT_SHM:         return "shm";
+        default:                    return "unknown";
+    }
+}
+
+#endif
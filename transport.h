@@ -0,0 +1,78 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "user.h"
+#include "fifo.h"
+
+// байтовая линия между узлами (только LINUX): через ядро - pipe, UNIX socketpair или псевдотерминал,
+// без системных вызовов - кольца SPSC FIFO в общей памяти процессов (memfd)
+// HDLC по-прежнему пишет в FIFO и читает из FIFO, транспорт переносит непрерывные участки FIFO
+// неблокирующими readv/writev (до двух участков с учетом перехода через конец буффера за один вызов) или memcpy
+#ifdef LINUX
+
+#define TRANSPORT_CLOSED        (-1)                // линия закрыта другой стороной или ошибка ввода-вывода
+#define TRANSPORT_SPIN_COUNT    4096                // опросов общей памяти перед засыпанием на futex (SHM, больше одного процессора)
+
+typedef enum                                        // вид линии
+{
+    TRANSPORT_PIPE,                                 // два однонаправленных канала pipe
+    TRANSPORT_SOCKETPAIR,                           // двунаправленная пара UNIX-сокетов
+    TRANSPORT_PTY,                                  // псевдотерминал в режиме raw (замена последовательного порта)
+    TRANSPORT_SHM                                   // кольца в общей памяти, futex только для спящей стороны (требует FIFO_SPSC)
+} transport_kind_typedef;
+
+struct transport_shared;                            // общая память линии TRANSPORT_SHM (transport.c)
+
+typedef struct                                      // один конец линии
+{
+    transport_kind_typedef kind;                    // вид линии
+    int rx_fd;                                      // дескриптор чтения из линии
+    int tx_fd;                                      // дескриптор записи в линию (у socketpair и PTY совпадает с rx_fd; у SHM -1)
+    struct transport_shared* shared;                // общая память линии TRANSPORT_SHM (NULL у остальных)
+    uint8_t side;                                   // номер конца в общей памяти (0 или 1)
+    fifo_typedef* rx_fifo;                          // принятые байты для HDLC
+    fifo_typedef* tx_fifo;                          // байты HDLC для отправки
+    bool readable;                                  // в ядре могут быть данные (сбрасывается при EAGAIN или неполном чтении)
+    bool writable;                                  // в ядре может быть место (сбрасывается при EAGAIN или неполной записи)
+    uint64_t rx_bytes;                              // принято байт
+    uint64_t rx_calls;                              // вызовов readv (копирований из кольца), вернувших данные
+    uint64_t tx_bytes;                              // отправлено байт
+    uint64_t tx_calls;                              // вызовов writev (копирований в кольцо), принявших данные
+} transport_typedef;
+
+// функция создания линии и двух ее концов (неблокирующие дескрипторы); false - ошибка (errno)
+bool TRANSPORT_OpenPair(transport_kind_typedef kind, transport_typedef* first, transport_typedef* second);
+
+// функция привязки FIFO приёма и передачи к концу линии
+void TRANSPORT_Attach(transport_typedef* transport, fifo_typedef* rx_fifo, fifo_typedef* tx_fifo);
+
+// функция закрытия конца линии
+// у SHM конец без привязанных FIFO (конец другого процесса после fork) только забывается,
+// привязанный конец сообщает о закрытии другой стороне и освобождает общую память
+void TRANSPORT_Close(transport_typedef* transport);
+
+// функция чтения из линии в свободное место rx_fifo одним readv
+// возвращает количество принятых байт (0 - данных нет или FIFO полон) или TRANSPORT_CLOSED
+int32_t TRANSPORT_Receive(transport_typedef* transport);
+
+// функция записи данных tx_fifo в линию одним writev
+// возвращает количество отправленных байт (0 - линия занята или FIFO пуст) или TRANSPORT_CLOSED
+int32_t TRANSPORT_Send(transport_typedef* transport);
+
+// функция подготовки к ожиданию линии SHM (вызывается до проверки колец, результат передается в TRANSPORT_WaitShared)
+uint32_t TRANSPORT_PrepareWait(transport_typedef* transport);
+
+// функция ожидания действия другой стороны линии SHM (timeout_us = 0 - без ограничения)
+void TRANSPORT_WaitShared(transport_typedef* transport, uint32_t sequence, uint32_t timeout_us);
+
+// функция учета готовности дескриптора fd, сообщенной epoll (флаги EPOLLIN, EPOLLOUT, EPOLLHUP, EPOLLERR)
+void TRANSPORT_HandleEvents(transport_typedef* transport, int fd, uint32_t events);
+
+// имя вида линии ("pipe", "socketpair", "pty" или "shm")
+const char* TRANSPORT_KindName(transport_kind_typedef kind);
+
+#endif
+
+#endif
@@ -3,16 +3,43 @@
 
 /*-----------------------------------------------------USER VARIABLES-----------------------------------------------------------------------------------------*/
 #define USER_INFO_PACK          {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F}    // информационное поле
-#define HDLC_INFO_SIZE          16                      // размер информационного поля HDLC
-#define USER_COMMAND            0x01                    // выбор команды 0x01 (INVERSING_BYTES) or 0x02 (CMD_MIRRORING_BYTES)
-#define MASTER_WAIT_REPLY_MS    1000                    // 1000 милисекунд на ответ от ведущего
+#define HDLC_INFO_SIZE          16                      // размер информационного поля, отправляемого ведущим (элементов в USER_INFO_PACK)
+#define HDLC_INFO_MAX_SIZE      65536                   // максимальный размер информационного поля HDLC
+#define USER_COMMAND            0x01                    // выбор команды 0x01 (INVERSING_BYTES), 0x02 (CMD_MIRRORING_BYTES) или 0x03 (CMD_AGGREGATE: пакет инверсии и отражения USER_INFO_PACK, см. command.h)
+#define HDLC_SLAVE_COUNT        1                       // количество ведомых на шине (адреса HDLC_SLAVE_ADDR, HDLC_SLAVE_ADDR+1, ...)
+//#define MASTER_POLL_BROADCAST                         // добавить широковещательный кадр (0xFF) в цикл опроса ведущего
+#define HDLC_SEQ_MODULO         0                       // нумерация I-кадров N(S)/N(R): 0 - нет (ожидание ответа на каждый кадр), 8 или 128
+#define MASTER_WINDOW_SIZE      4                       // окно ведущего: неподтвержденных кадров (не больше HDLC_SEQ_MODULO-1)
+#ifndef FRAME_POOL_SIZE
+#define FRAME_POOL_SIZE         (MASTER_WINDOW_SIZE + 2 * HDLC_SLAVE_COUNT + 2) // буфферов кадров в пуле: окно, кадр в передаче, приём каждого узла и ответ ведомого
+#endif
+#define MASTER_WAIT_REPLY_MS    1000                    // 1000 милисекунд на ответ от ведущего до первого измерения RTT
+#define MASTER_RTO_MIN_US       10000                   // наименьший таймаут ответа по измеренному RTT, мкс (запас на задержки планировщика ОС)
+#define MASTER_RTO_MAX_US       4000000                 // наибольший таймаут ответа (в том числе после удвоений), мкс
+#define MASTER_REJECT_LIMIT     3                       // повторов кадра по REJ подряд, дальше - только по таймауту с удвоением RTO
+#define CRC_ENGINE              CRC_ENGINE_SLICE8       // расчет FCS: CRC_ENGINE_BITWISE, CRC_ENGINE_TABLE или CRC_ENGINE_SLICE8
 
 //#define LINUX                                   // необходимо раскомментировать/закомментировать в случае использования/не использования
 #define WINDOWS                                 // необходимо раскомментировать/закомментировать в случае использования/не использования
 
-#define TX_MORE_INFO                                    // позволяет отобразить отправленный из буффера байт
-#define RX_MORE_INFO                                    // позволяет отобразить принятый в буффер байт
-#define MORE_FIFO_INFO                                  // позволяет отобразить данные FIFO после каждой итерации
+//#define FIFO_SPSC                               // FIFO без блокировок (один писатель и один читатель в разных потоках), FIFO_SIZE - степень двойки
+//#define THREADED_MODE                           // ведущий и ведомый в отдельных потоках с ожиданием на futex (требует LINUX и FIFO_SPSC)
+//#define PROCESS_MODE                            // ведущий и ведомый в отдельных процессах, байты идут через ядро (требует LINUX)
+#define PROCESS_TRANSPORT       TRANSPORT_SOCKETPAIR    // линия PROCESS_MODE: TRANSPORT_PIPE, TRANSPORT_SOCKETPAIR, TRANSPORT_PTY или TRANSPORT_SHM (FIFO_SPSC)
+
+//#define CHANNEL_FAULTS                          // линия ведущий-ведомый с искажениями (channel.h): профиль CHANNEL_PROFILE в обе стороны
+#define CHANNEL_PROFILE         {.bit_error_rate = 1e-5, .drop_rate = 1e-5, .burst_rate = 1e-6, .burst_length = 8, .flag_error_rate = 1e-3}
+#define CHANNEL_SEED            1                       // начальное значение генератора искажений (ответная сторона - CHANNEL_SEED+1)
+
+#define METRICS_PERIOD_MS       1000                    // период выгрузки снимка метрик узлов (metrics.h)
+//#define METRICS_FILE            "hdlc_metrics.json"     // снимок метрик в файл JSON (заменяется целиком через временный файл)
+//#define METRICS_SHM_PATH        "/dev/shm/hdlc_metrics" // снимок метрик в общей памяти для внешнего читателя (LINUX, формат и протокол чтения - metrics.h)
+
+#if defined(PROCESS_MODE) && !defined(FIFO_SIZE)
+#define FIFO_SIZE               4096                    // FIFO вмещает несколько кадров: один readv/writev на пачку кадров
+#endif
+
+// подробность отладочного вывода задается при запуске: HDLC_TRACE_LEVEL=off|error|info|debug|byte (см. trace.h)
 /*---------------------------------------------------USER VARIABLES END----------------------------------------------------------------------------------------*/
 
 #endif
\ No newline at end of file